@@ -0,0 +1,358 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "bench_compare.h"
+#include "ini.h"
+
+/*
+ * End to end benchmark over a corpus file, e.g. one from gen_ini. Each phase
+ * runs warmup times untimed and then runs times, the JSON on stdout has
+ * every sample along with medians and derived rates.
+ *
+ *   cc -O2 -DINI_NO_MAIN -c main.c && cc -O2 -pthread bench.c main.o -lm -o bench
+ *   ./bench corpus.ini --runs 30 > result.json
+ *   ./bench corpus.ini --compare result.json --threshold 5 > new.json
+ *
+ * With --compare, each phase is checked against the baseline's samples
+ * and the exit status is 1 when any of them regressed.
+ */
+
+/*
+ * ------------------------------------
+ * Samples
+ * ------------------------------------
+ */
+typedef struct {
+  const char *name;
+  double *samples;   // Wall time of each run in ns
+  size_t runs;
+  size_t ops;        // Entries or lookups done per run
+  size_t bytes;      // Input bytes per run, 0 for lookups
+  size_t high_water; // Most allocator bytes held at the end of a run
+  long peak_rss_kb;  // Process peak after the phase, phases only add to it
+} Phase;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static int double_cmp(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+// Nearest rank percentile of sorted samples
+static double percentile(const double *sorted, size_t len, double p) {
+  size_t rank = (size_t)(p / 100.0 * len + 0.999999);
+  if (rank == 0)
+    rank = 1;
+  return sorted[rank > len ? len - 1 : rank - 1];
+}
+
+/*
+ * ------------------------------------
+ * Phases
+ * ------------------------------------
+ * Each run function does the work once, and returns the allocator
+ * high water mark
+ * ------------------------------------
+ */
+typedef struct {
+  const char *path;
+  const char *input;
+  size_t len;
+  IniConfig config; // Parsed once, for the lookups
+  const char **sections;
+  size_t *section_lens;
+  const char **keys; // Keys for hits, the same with a '~' appended for misses
+  size_t *key_lens;
+  char **miss_keys;
+  size_t lookups;
+  uintptr_t sink;
+} Bench;
+
+static size_t run_read_file(Bench *bench) {
+  LinearAllocator allocator;
+  allocator_init(&allocator);
+  const char *input = read_file(bench->path, &allocator, NULL);
+  bench->sink += (uintptr_t)input;
+  size_t used = allocator.used;
+  allocator_free(&allocator);
+  return used;
+}
+
+// Scanning and literal copies only, no table or index
+static size_t run_lex(Bench *bench) {
+  LinearAllocator allocator;
+  allocator_init(&allocator);
+  IniParser parser = new_parser(bench->input, bench->len);
+  while (parse_next(&parser, NULL, &allocator)) { }
+  size_t used = allocator.used;
+  allocator_free(&allocator);
+  return used;
+}
+
+static size_t run_parse(Bench *bench) {
+  IniConfig config;
+  if (ini_parse_buffer(&config, bench->input, bench->len) != 0) {
+    fprintf(stderr, "%s: parse failed\n", bench->path);
+    exit(EXIT_FAILURE);
+  }
+  size_t used = config.allocator.used;
+  ini_config_free(&config);
+  return used;
+}
+
+static size_t run_lookup_hit(Bench *bench) {
+  size_t entries = bench->config.index.len;
+  for (size_t i = 0; i < bench->lookups; i++) {
+    size_t e = i % entries;
+    bench->sink += (uintptr_t)ini_lookup(&bench->config, bench->sections[e],
+                                         bench->section_lens[e], bench->keys[e],
+                                         bench->key_lens[e]);
+  }
+  return bench->config.allocator.used;
+}
+
+static size_t run_lookup_miss(Bench *bench) {
+  size_t entries = bench->config.index.len;
+  for (size_t i = 0; i < bench->lookups; i++) {
+    size_t e = i % entries;
+    bench->sink += (uintptr_t)ini_lookup(&bench->config, bench->sections[e],
+                                         bench->section_lens[e],
+                                         bench->miss_keys[e],
+                                         bench->key_lens[e] + 1);
+  }
+  return bench->config.allocator.used;
+}
+
+static void run_phase(Bench *bench, Phase *phase, size_t (*run)(Bench *),
+                      size_t warmup) {
+  for (size_t i = 0; i < warmup; i++)
+    run(bench);
+
+  for (size_t i = 0; i < phase->runs; i++) {
+    double start = now_ns();
+    size_t used = run(bench);
+    phase->samples[i] = now_ns() - start;
+    if (used > phase->high_water)
+      phase->high_water = used;
+  }
+  phase->peak_rss_kb = peak_rss_kb();
+}
+
+// Lookup keys in entry order, which is sorted, so shuffle them with a
+// fixed seed to keep the access pattern the same between runs
+static void prepare_lookups(Bench *bench) {
+  IniEntryIndex *index = &bench->config.index;
+  size_t n = index->len;
+  bench->sections = malloc(n * sizeof(char *));
+  bench->section_lens = malloc(n * sizeof(size_t));
+  bench->keys = malloc(n * sizeof(char *));
+  bench->key_lens = malloc(n * sizeof(size_t));
+  bench->miss_keys = malloc(n * sizeof(char *));
+  if (!bench->sections || !bench->section_lens || !bench->keys ||
+      !bench->key_lens || !bench->miss_keys) {
+    fprintf(stderr, "Failed to allocate lookup keys\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  size_t *order = malloc(n * sizeof(size_t));
+  for (size_t i = 0; i < n; i++)
+    order[i] = i;
+  for (size_t i = n; i > 1; i--) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    size_t j = state % i;
+    size_t tmp = order[i - 1];
+    order[i - 1] = order[j];
+    order[j] = tmp;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    const IniEntry *entry = &index->entries[order[i]];
+    bench->sections[i] = entry->section ? entry->section : "";
+    bench->section_lens[i] = strlen(bench->sections[i]);
+    bench->keys[i] = entry->key;
+    bench->key_lens[i] = strlen(entry->key);
+    // '~' can't appear in a key, so these always miss
+    bench->miss_keys[i] = malloc(bench->key_lens[i] + 2);
+    memcpy(bench->miss_keys[i], entry->key, bench->key_lens[i]);
+    memcpy(bench->miss_keys[i] + bench->key_lens[i], "~", 2);
+  }
+  free(order);
+}
+
+/*
+ * ------------------------------------
+ * Output
+ * ------------------------------------
+ */
+static void print_phase(const Phase *phase, int last) {
+  double *sorted = malloc(phase->runs * sizeof(double));
+  memcpy(sorted, phase->samples, phase->runs * sizeof(double));
+  qsort(sorted, phase->runs, sizeof(double), double_cmp);
+  double median = percentile(sorted, phase->runs, 50);
+  double p99 = percentile(sorted, phase->runs, 99);
+
+  printf("    {\n      \"name\": \"%s\",\n", phase->name);
+  printf("      \"runs\": %zu,\n", phase->runs);
+  printf("      \"median_ns\": %.0f,\n", median);
+  printf("      \"p99_ns\": %.0f,\n", p99);
+  printf("      \"min_ns\": %.0f,\n", sorted[0]);
+  if (phase->bytes > 0) {
+    printf("      \"mb_per_s\": %.2f,\n", phase->bytes / (median / 1e9) / 1e6);
+    printf("      \"ns_per_entry\": %.2f,\n", median / phase->ops);
+  } else {
+    printf("      \"ns_per_lookup\": %.2f,\n", median / phase->ops);
+    printf("      \"p99_ns_per_lookup\": %.2f,\n", p99 / phase->ops);
+  }
+  printf("      \"alloc_high_water\": %zu,\n", phase->high_water);
+  printf("      \"peak_rss_kb\": %ld,\n", phase->peak_rss_kb);
+  printf("      \"samples_ns\": [");
+  for (size_t i = 0; i < phase->runs; i++)
+    printf("%s%.0f", i ? ", " : "", phase->samples[i]);
+  printf("]\n    }%s\n", last ? "" : ",");
+  free(sorted);
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: bench <corpus.ini> [--runs <n>] [--warmup <n>] "
+                  "[--lookups <n>]\n"
+                  "             [--compare <baseline.json>] [--threshold <%%>] "
+                  "[--mem-threshold <%%>] [--alpha <p>]\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc % 2 != 0) {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  size_t runs = 20, warmup = 3, lookups = 1000000;
+  const char *compare = NULL;
+  Baseline baseline = {.threshold = 0.05, .mem_threshold = 0.10, .alpha = 0.01};
+  for (int i = 2; i < argc; i += 2) {
+    size_t value = strtoull(argv[i + 1], NULL, 10);
+    if (strcmp(argv[i], "--runs") == 0 && value > 0) {
+      runs = value;
+    } else if (strcmp(argv[i], "--warmup") == 0) {
+      warmup = value;
+    } else if (strcmp(argv[i], "--lookups") == 0 && value > 0) {
+      lookups = value;
+    } else if (strcmp(argv[i], "--compare") == 0) {
+      compare = argv[i + 1];
+    } else if (strcmp(argv[i], "--threshold") == 0) {
+      baseline.threshold = strtod(argv[i + 1], NULL) / 100;
+    } else if (strcmp(argv[i], "--mem-threshold") == 0) {
+      baseline.mem_threshold = strtod(argv[i + 1], NULL) / 100;
+    } else if (strcmp(argv[i], "--alpha") == 0) {
+      baseline.alpha = strtod(argv[i + 1], NULL);
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (compare != NULL) {
+    if (baseline_load(&baseline, compare) != 0)
+      return EXIT_FAILURE;
+    if (runs < COMPARE_MIN_RUNS)
+      runs = COMPARE_MIN_RUNS;
+  }
+
+  Bench bench = {.path = argv[1], .lookups = lookups};
+  LinearAllocator input_allocator;
+  allocator_init(&input_allocator);
+  bench.input = read_file(bench.path, &input_allocator, &bench.len);
+  if (bench.input == NULL) {
+    perror(bench.path);
+    return EXIT_FAILURE;
+  }
+
+  if (ini_parse_buffer(&bench.config, bench.input, bench.len) != 0) {
+    fprintf(stderr, "%s: parse failed\n", bench.path);
+    return EXIT_FAILURE;
+  }
+  size_t entries = bench.config.index.len;
+  if (entries == 0) {
+    fprintf(stderr, "%s: no entries\n", bench.path);
+    return EXIT_FAILURE;
+  }
+  prepare_lookups(&bench);
+
+  // The parser counts every assignment, duplicates included
+  IniParser counter = new_parser(bench.input, bench.len);
+  LinearAllocator scratch;
+  allocator_init(&scratch);
+  while (parse_next(&counter, NULL, &scratch)) { }
+  allocator_free(&scratch);
+  size_t assignments = counter.entries;
+
+  struct {
+    const char *name;
+    size_t (*run)(Bench *);
+    size_t ops;
+    size_t bytes;
+  } plan[] = {
+      {"read_file", run_read_file, assignments, bench.len},
+      {"lex", run_lex, assignments, bench.len},
+      {"parse_ini", run_parse, assignments, bench.len},
+      {"lookup_hit", run_lookup_hit, lookups, 0},
+      {"lookup_miss", run_lookup_miss, lookups, 0},
+  };
+  size_t phases = sizeof(plan) / sizeof(plan[0]);
+
+  printf("{\n  \"corpus\": \"%s\",\n", bench.path);
+  printf("  \"bytes\": %zu,\n  \"entries\": %zu,\n", bench.len, entries);
+  printf("  \"warmup\": %zu,\n  \"phases\": [\n", warmup);
+  for (size_t i = 0; i < phases; i++) {
+    Phase phase = {plan[i].name, calloc(runs, sizeof(double)), runs,
+                   plan[i].ops, plan[i].bytes, 0, 0};
+    run_phase(&bench, &phase, plan[i].run, warmup);
+    print_phase(&phase, i + 1 == phases);
+    if (compare != NULL)
+      baseline_check(&baseline, phase.name, phase.samples, phase.runs,
+                     phase.high_water, phase.peak_rss_kb);
+    free(phase.samples);
+  }
+  printf("  ]\n}\n");
+
+  // Keeps the lookups from being optimised out
+  if (bench.sink == 1)
+    fprintf(stderr, "\n");
+
+  for (size_t i = 0; i < entries; i++)
+    free(bench.miss_keys[i]);
+  free(bench.sections);
+  free(bench.section_lens);
+  free(bench.keys);
+  free(bench.key_lens);
+  free(bench.miss_keys);
+  ini_config_free(&bench.config);
+  allocator_free(&input_allocator);
+
+  if (compare != NULL) {
+    size_t regressions = baseline.regressions;
+    baseline_free(&baseline);
+    if (regressions > 0) {
+      fprintf(stderr, "%zu regression(s) against %s\n", regressions, compare);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,238 @@
+#ifndef BENCH_COMPARE_H
+#define BENCH_COMPARE_H
+
+/*
+ * Baseline comparison shared by bench.c and bench_table.c. Loads the
+ * samples of a previous run's JSON and checks new samples against them
+ * with a one-sided Mann-Whitney U test: a benchmark regresses when it is
+ * slower with p < alpha and its median grew by more than the threshold.
+ * Memory figures are single values and only checked against a threshold.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fewest runs per benchmark in compare mode, fewer and the U test can't
+// reach significance
+#define COMPARE_MIN_RUNS 20
+
+typedef struct {
+  char *name;
+  double *samples;
+  size_t runs;
+  double high_water;  // -1 when the baseline has none
+  double peak_rss_kb; // Same
+} BaselineEntry;
+
+typedef struct {
+  BaselineEntry *entries;
+  size_t len;
+  double threshold;     // Fraction the median may grow by, e.g. 0.05
+  double mem_threshold; // Same for the memory figures
+  double alpha;         // Significance level of the U test
+  size_t regressions;
+} Baseline;
+
+static double baseline_number(const char *object, const char *end,
+                              const char *field) {
+  const char *found = strstr(object, field);
+  if (found == NULL || found > end)
+    return -1;
+  return strtod(found + strlen(field), NULL);
+}
+
+// Reads the phases of a JSON file written by bench or bench_table. Not a
+// general JSON parser, it relies on the layout those two print.
+static int baseline_load(Baseline *baseline, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return -1;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char *json = malloc(size + 1);
+  if (json == NULL || fread(json, 1, size, file) != (size_t)size) {
+    fprintf(stderr, "%s: failed to read\n", path);
+    fclose(file);
+    free(json);
+    return -1;
+  }
+  json[size] = '\0';
+  fclose(file);
+
+  size_t cap = 0;
+  baseline->entries = NULL;
+  baseline->len = 0;
+  baseline->regressions = 0;
+
+  const char *key = "\"name\": \"";
+  for (char *p = strstr(json, key); p != NULL;) {
+    char *name = p + strlen(key);
+    char *name_end = strchr(name, '"');
+    char *next = strstr(name, key);
+    char *end = next ? next : json + size;
+    char *samples = strstr(name, "\"samples_ns\": [");
+    p = next;
+    if (name_end == NULL || samples == NULL || samples > end)
+      continue; // e.g. probe histograms
+
+    if (baseline->len == cap) {
+      cap = cap ? cap * 2 : 64;
+      baseline->entries = realloc(baseline->entries, cap * sizeof(BaselineEntry));
+    }
+    BaselineEntry *entry = &baseline->entries[baseline->len++];
+    entry->name = strndup(name, name_end - name);
+    entry->high_water = baseline_number(name, end, "\"alloc_high_water\": ");
+    entry->peak_rss_kb = baseline_number(name, end, "\"peak_rss_kb\": ");
+
+    entry->runs = 0;
+    size_t samples_cap = 16;
+    entry->samples = malloc(samples_cap * sizeof(double));
+    char *s = samples + strlen("\"samples_ns\": [");
+    while (*s != ']') {
+      char *after;
+      double value = strtod(s, &after);
+      if (after == s)
+        break;
+      if (entry->runs == samples_cap) {
+        samples_cap *= 2;
+        entry->samples = realloc(entry->samples, samples_cap * sizeof(double));
+      }
+      entry->samples[entry->runs++] = value;
+      s = after;
+      while (*s == ',' || *s == ' ' || *s == '\n')
+        s++;
+    }
+  }
+
+  free(json);
+  if (baseline->len == 0) {
+    fprintf(stderr, "%s: no benchmarks found\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+static void baseline_free(Baseline *baseline) {
+  for (size_t i = 0; i < baseline->len; i++) {
+    free(baseline->entries[i].name);
+    free(baseline->entries[i].samples);
+  }
+  free(baseline->entries);
+  baseline->entries = NULL;
+  baseline->len = 0;
+}
+
+static int baseline_double_cmp(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static double baseline_median(const double *samples, size_t n) {
+  double *sorted = malloc(n * sizeof(double));
+  memcpy(sorted, samples, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), baseline_double_cmp);
+  double median =
+      n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+  free(sorted);
+  return median;
+}
+
+typedef struct {
+  double value;
+  int current; // 1 for the new run, 0 for the baseline
+} RankedSample;
+
+static int ranked_cmp(const void *a, const void *b) {
+  return baseline_double_cmp(&((const RankedSample *)a)->value,
+                             &((const RankedSample *)b)->value);
+}
+
+// p-value that current is stochastically greater than base, normal
+// approximation with tie correction, fine from about 8 samples a side
+static double mann_whitney_greater(const double *base, size_t n1,
+                                   const double *current, size_t n2) {
+  size_t n = n1 + n2;
+  RankedSample *all = malloc(n * sizeof(RankedSample));
+  for (size_t i = 0; i < n1; i++)
+    all[i] = (RankedSample){base[i], 0};
+  for (size_t i = 0; i < n2; i++)
+    all[n1 + i] = (RankedSample){current[i], 1};
+  qsort(all, n, sizeof(RankedSample), ranked_cmp);
+
+  // Ties share the mean of their ranks
+  double rank_sum = 0, ties = 0;
+  for (size_t i = 0; i < n;) {
+    size_t j = i;
+    while (j < n && all[j].value == all[i].value)
+      j++;
+    double rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++)
+      if (all[k].current)
+        rank_sum += rank;
+    double t = j - i;
+    ties += t * t * t - t;
+    i = j;
+  }
+  free(all);
+
+  double u = rank_sum - n2 * (n2 + 1) / 2.0;
+  double mean = n1 * n2 / 2.0;
+  double var = n1 * n2 / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+  if (var <= 0)
+    return 1;
+  // Continuity correction towards the mean
+  double z = (u - mean - 0.5) / sqrt(var);
+  return 0.5 * erfc(z / sqrt(2));
+}
+
+static void baseline_check_value(Baseline *baseline, const char *name,
+                                 const char *metric, double before,
+                                 double after) {
+  if (before <= 0 || after < 0)
+    return;
+  double change = after / before - 1;
+  if (change > baseline->mem_threshold) {
+    fprintf(stderr, "REGRESSION %s %s: %.0f -> %.0f (%+.1f%%)\n", name, metric,
+            before, after, change * 100);
+    baseline->regressions++;
+  }
+}
+
+// Checks one benchmark, memory figures < 0 are skipped
+static void baseline_check(Baseline *baseline, const char *name,
+                           const double *samples, size_t runs,
+                           double high_water, double peak_rss_kb) {
+  const BaselineEntry *entry = NULL;
+  for (size_t i = 0; i < baseline->len && entry == NULL; i++) {
+    if (strcmp(baseline->entries[i].name, name) == 0)
+      entry = &baseline->entries[i];
+  }
+  if (entry == NULL) {
+    fprintf(stderr, "new        %s\n", name);
+    return;
+  }
+
+  double before = baseline_median(entry->samples, entry->runs);
+  double after = baseline_median(samples, runs);
+  double change = after / before - 1;
+  double p = mann_whitney_greater(entry->samples, entry->runs, samples, runs);
+  int regressed = p < baseline->alpha && change > baseline->threshold;
+
+  fprintf(stderr, "%-10s %s: %.1f -> %.1f ns (%+.1f%%, p=%.4f)\n",
+          regressed ? "REGRESSION" : "ok", name, before, after, change * 100,
+          p);
+  if (regressed)
+    baseline->regressions++;
+
+  baseline_check_value(baseline, name, "alloc_high_water", entry->high_water,
+                       high_water);
+  baseline_check_value(baseline, name, "peak_rss_kb", entry->peak_rss_kb,
+                       peak_rss_kb);
+}
+
+#endif
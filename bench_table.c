@@ -0,0 +1,386 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench_compare.h"
+#include "ini.h"
+
+/*
+ * SHashTable microbenchmark. Sweeps table size from L1 resident up to
+ * DRAM resident, load factor and key length, timing shasht_set,
+ * shasht_get at several hit ratios and shasht_delete, and prints the probe
+ * length histogram of every filled table. Same JSON layout as bench.c,
+ * samples are ns per operation.
+ *
+ *   cc -O2 -DINI_NO_MAIN -c main.c
+ *   cc -O2 -pthread bench_table.c main.o -lm -o bench_table
+ *   ./bench_table --runs 10 > table.json
+ *   ./bench_table --compare table.json > new.json
+ */
+
+#define MIN_OPS_PER_SAMPLE 100000
+#define PROBE_BUCKETS 9
+
+static const size_t table_caps[] = {1 << 10, 1 << 14, 1 << 17, 1 << 20,
+                                    1 << 22};
+static const unsigned load_factors[] = {10, 25, 50, 75, 90, 95};
+static const unsigned hit_ratios[] = {100, 90, 50, 0};
+
+typedef struct {
+  const char *name;
+  size_t min;
+  size_t max;
+} KeyLength;
+
+// Short keys, qualified "section.key" sized and long generated names
+static const KeyLength key_lengths[] = {
+    {"short", 4, 12}, {"medium", 16, 32}, {"long", 48, 96}};
+
+/*
+ * ------------------------------------
+ * Helpers
+ * ------------------------------------
+ */
+typedef struct {
+  uint64_t state;
+} Rng;
+
+static uint64_t rng_next(Rng *rng) {
+  uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int double_cmp(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static void shuffle(char **keys, size_t n, Rng *rng) {
+  for (size_t i = n; i > 1; i--) {
+    size_t j = rng_next(rng) % i;
+    char *tmp = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = tmp;
+  }
+}
+
+// n distinct random keys, distinct since each ends in its index in base 62
+static char **make_keys(size_t n, const KeyLength *length, char tag, Rng *rng,
+                        LinearAllocator *allocator) {
+  static const char chars[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  char **keys = malloc(n * sizeof(char *));
+  if (keys == NULL) {
+    fprintf(stderr, "Failed to allocate keys\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    size_t len = length->min + rng_next(rng) % (length->max - length->min + 1);
+    // Room for the tag, '_' and every digit of the index
+    size_t digits = 1;
+    for (size_t id = i; id >= 62; id /= 62)
+      digits++;
+    if (len < digits + 2)
+      len = digits + 2;
+    char *key = allocator_alloc(allocator, len + 1);
+    if (key == NULL) {
+      fprintf(stderr, "Failed to allocate keys\n");
+      exit(EXIT_FAILURE);
+    }
+    key[0] = tag;
+    size_t pos = len, id = i;
+    // Index suffix first, random characters fill what is left
+    do {
+      key[--pos] = chars[id % 62];
+      id /= 62;
+    } while (id > 0);
+    key[--pos] = '_';
+    for (size_t c = 1; c < pos; c++)
+      key[c] = chars[rng_next(rng) % 62];
+    key[len] = '\0';
+    keys[i] = key;
+  }
+  return keys;
+}
+
+/*
+ * ------------------------------------
+ * Output
+ * ------------------------------------
+ */
+static int first_result = 1;
+static Baseline *baseline; // Set in compare mode
+
+static void print_result(const char *op, size_t cap, unsigned load,
+                         const KeyLength *length, const double *samples,
+                         size_t runs) {
+  double *sorted = malloc(runs * sizeof(double));
+  memcpy(sorted, samples, runs * sizeof(double));
+  qsort(sorted, runs, sizeof(double), double_cmp);
+
+  printf("%s    {\n", first_result ? "" : ",\n");
+  first_result = 0;
+  printf("      \"name\": \"%s cap=%zu load=%u key=%s\",\n", op, cap, load,
+         length->name);
+  printf("      \"runs\": %zu,\n", runs);
+  printf("      \"median_ns\": %.2f,\n", sorted[runs / 2]);
+  printf("      \"p99_ns\": %.2f,\n", sorted[(runs * 99 + 99) / 100 - 1]);
+  printf("      \"min_ns\": %.2f,\n", sorted[0]);
+  printf("      \"samples_ns\": [");
+  for (size_t i = 0; i < runs; i++)
+    printf("%s%.2f", i ? ", " : "", samples[i]);
+  printf("]\n    }");
+  free(sorted);
+
+  if (baseline != NULL) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s cap=%zu load=%u key=%s", op, cap, load,
+             length->name);
+    baseline_check(baseline, name, samples, runs, -1, -1);
+  }
+}
+
+// Probe length of each filled slot: 0, 1, 2, 3, 4, 5-8, 9-16, 17-32, 33+
+static void print_probes(size_t cap, unsigned load, const KeyLength *length,
+                         const SHashTable *table) {
+  static const size_t bounds[PROBE_BUCKETS] = {0, 1, 2, 3, 4, 8, 16, 32,
+                                               SIZE_MAX};
+  size_t buckets[PROBE_BUCKETS] = {0};
+  size_t total = 0, max = 0;
+
+  for (size_t i = 0; i < table->cap; i++) {
+    const char *key = table->entries[i].key;
+    if (key == NULL)
+      continue;
+
+    size_t distance = (i - shasht_home(table, key)) & (table->cap - 1);
+
+    size_t b = 0;
+    while (distance > bounds[b])
+      b++;
+    buckets[b]++;
+    total += distance;
+    if (distance > max)
+      max = distance;
+  }
+
+  printf("%s    {\n", first_result ? "" : ",\n");
+  first_result = 0;
+  printf("      \"name\": \"probes cap=%zu load=%u key=%s\",\n", cap, load,
+         length->name);
+  printf("      \"entries\": %zu,\n", table->len);
+  printf("      \"mean\": %.3f,\n", table->len ? (double)total / table->len : 0);
+  printf("      \"max\": %zu,\n", max);
+  printf("      \"histogram\": {\"0\": %zu, \"1\": %zu, \"2\": %zu, \"3\": %zu, "
+         "\"4\": %zu, \"5-8\": %zu, \"9-16\": %zu, \"17-32\": %zu, "
+         "\"33+\": %zu}\n    }",
+         buckets[0], buckets[1], buckets[2], buckets[3], buckets[4],
+         buckets[5], buckets[6], buckets[7], buckets[8]);
+}
+
+/*
+ * ------------------------------------
+ * Benchmarks
+ * ------------------------------------
+ */
+typedef struct {
+  size_t cap;
+  unsigned load;
+  const KeyLength *length;
+  size_t runs;
+  char **keys;   // n keys to insert
+  char **misses; // n keys never inserted
+  size_t n;
+  size_t reps; // Repeats per sample, so each times at least ~100k ops
+} Case;
+
+// An empty table that never grows while filled to the case's load
+static SHashTable *fresh_table(const Case *c, LinearAllocator *allocator) {
+  allocator_reset(allocator);
+  SHashTable *table = shasht_init_cap(allocator, c->cap);
+  if (table == NULL) {
+    fprintf(stderr, "Failed to allocate table\n");
+    exit(EXIT_FAILURE);
+  }
+  shasht_set_max_load(table, 95);
+  return table;
+}
+
+static void fill(SHashTable *table, const Case *c, LinearAllocator *allocator) {
+  for (size_t i = 0; i < c->n; i++)
+    shasht_set(table, c->keys[i], c->keys[i], allocator, NULL);
+}
+
+static void bench_set(const Case *c, LinearAllocator *allocator,
+                      double *samples) {
+  for (size_t run = 0; run < c->runs; run++) {
+    double elapsed = 0;
+    for (size_t rep = 0; rep < c->reps; rep++) {
+      SHashTable *table = fresh_table(c, allocator);
+      double start = now_ns();
+      fill(table, c, allocator);
+      elapsed += now_ns() - start;
+    }
+    samples[run] = elapsed / (c->n * c->reps);
+  }
+  print_result("set", c->cap, c->load, c->length, samples, c->runs);
+}
+
+static void bench_get(const Case *c, SHashTable *table, unsigned hit_ratio,
+                      Rng *rng, double *samples) {
+  // Queries drawn once, so every run walks the same sequence
+  char **queries = malloc(c->n * sizeof(char *));
+  for (size_t i = 0; i < c->n; i++) {
+    int hit = rng_next(rng) % 100 < hit_ratio;
+    queries[i] = hit ? c->keys[rng_next(rng) % c->n]
+                     : c->misses[rng_next(rng) % c->n];
+  }
+
+  uintptr_t sink = 0;
+  for (size_t run = 0; run < c->runs; run++) {
+    double start = now_ns();
+    for (size_t rep = 0; rep < c->reps; rep++) {
+      for (size_t i = 0; i < c->n; i++)
+        sink += (uintptr_t)shasht_get(table, queries[i]);
+    }
+    samples[run] = (now_ns() - start) / (c->n * c->reps);
+  }
+  if (sink == 1)
+    fprintf(stderr, "\n");
+
+  char op[32];
+  snprintf(op, sizeof(op), "get_hit%u", hit_ratio);
+  print_result(op, c->cap, c->load, c->length, samples, c->runs);
+  free(queries);
+}
+
+static void bench_delete(const Case *c, LinearAllocator *allocator, Rng *rng,
+                         double *samples) {
+  for (size_t run = 0; run < c->runs; run++) {
+    double elapsed = 0;
+    for (size_t rep = 0; rep < c->reps; rep++) {
+      SHashTable *table = fresh_table(c, allocator);
+      fill(table, c, allocator);
+      shuffle(c->keys, c->n, rng);
+      double start = now_ns();
+      for (size_t i = 0; i < c->n; i++)
+        shasht_delete(table, c->keys[i]);
+      elapsed += now_ns() - start;
+    }
+    samples[run] = elapsed / (c->n * c->reps);
+  }
+  print_result("delete", c->cap, c->load, c->length, samples, c->runs);
+}
+
+static void run_case(Case *c, Rng *rng) {
+  LinearAllocator key_allocator, table_allocator;
+  allocator_init(&key_allocator);
+  allocator_init(&table_allocator);
+  double *samples = malloc(c->runs * sizeof(double));
+
+  c->keys = make_keys(c->n, c->length, 'k', rng, &key_allocator);
+  c->misses = make_keys(c->n, c->length, 'm', rng, &key_allocator);
+
+  bench_set(c, &table_allocator, samples);
+
+  SHashTable *table = fresh_table(c, &table_allocator);
+  fill(table, c, &table_allocator);
+  print_probes(c->cap, c->load, c->length, table);
+  for (size_t h = 0; h < sizeof(hit_ratios) / sizeof(hit_ratios[0]); h++)
+    bench_get(c, table, hit_ratios[h], rng, samples);
+
+  bench_delete(c, &table_allocator, rng, samples);
+
+  free(samples);
+  free(c->keys);
+  free(c->misses);
+  allocator_free(&key_allocator);
+  allocator_free(&table_allocator);
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: bench_table [--runs <n>] [--max-cap <slots>] "
+                  "[--seed <n>]\n"
+                  "                   [--compare <baseline.json>] "
+                  "[--threshold <%%>] [--alpha <p>]\n");
+}
+
+int main(int argc, char *argv[]) {
+  size_t runs = 10, max_cap = 1 << 20;
+  uint64_t seed = 1;
+  const char *compare = NULL;
+  Baseline loaded = {.threshold = 0.05, .mem_threshold = 0.10, .alpha = 0.01};
+  if (argc % 2 != 1) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  for (int i = 1; i < argc; i += 2) {
+    size_t value = strtoull(argv[i + 1], NULL, 10);
+    if (strcmp(argv[i], "--runs") == 0 && value > 0) {
+      runs = value;
+    } else if (strcmp(argv[i], "--max-cap") == 0) {
+      max_cap = value;
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = value;
+    } else if (strcmp(argv[i], "--compare") == 0) {
+      compare = argv[i + 1];
+    } else if (strcmp(argv[i], "--threshold") == 0) {
+      loaded.threshold = strtod(argv[i + 1], NULL) / 100;
+    } else if (strcmp(argv[i], "--alpha") == 0) {
+      loaded.alpha = strtod(argv[i + 1], NULL);
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (compare != NULL) {
+    if (baseline_load(&loaded, compare) != 0)
+      return EXIT_FAILURE;
+    baseline = &loaded;
+    if (runs < COMPARE_MIN_RUNS)
+      runs = COMPARE_MIN_RUNS;
+  }
+
+  Rng rng = {seed};
+  printf("{\n  \"phases\": [\n");
+  for (size_t s = 0; s < sizeof(table_caps) / sizeof(table_caps[0]); s++) {
+    if (table_caps[s] > max_cap)
+      break;
+    for (size_t l = 0; l < sizeof(load_factors) / sizeof(load_factors[0]);
+         l++) {
+      for (size_t k = 0; k < sizeof(key_lengths) / sizeof(key_lengths[0]);
+           k++) {
+        Case c = {.cap = table_caps[s],
+                  .load = load_factors[l],
+                  .length = &key_lengths[k],
+                  .runs = runs};
+        c.n = c.cap * c.load / 100;
+        c.reps = c.n >= MIN_OPS_PER_SAMPLE ? 1 : MIN_OPS_PER_SAMPLE / c.n;
+        run_case(&c, &rng);
+      }
+    }
+  }
+  printf("\n  ]\n}\n");
+
+  if (compare != NULL) {
+    size_t regressions = loaded.regressions;
+    baseline_free(&loaded);
+    if (regressions > 0) {
+      fprintf(stderr, "%zu regression(s) against %s\n", regressions, compare);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,329 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Synthetic INI corpus generator for benchmarking. The same seed and
+ * options always give the same bytes, within the grammar main.c accepts.
+ *
+ *   cc -O2 -o gen_ini gen_ini.c
+ *   gen_ini --seed 1 --size 64M --keys 20 --crlf 0.1 -o corpus.ini
+ */
+
+/*
+ * ------------------------------------
+ * Random
+ * ------------------------------------
+ * splitmix64, small and fast, every seed gives a good sequence
+ * ------------------------------------
+ */
+typedef struct {
+  uint64_t state;
+} Rng;
+
+static uint64_t rng_next(Rng *rng) {
+  uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [min, max]
+static size_t rng_range(Rng *rng, size_t min, size_t max) {
+  return min + rng_next(rng) % (max - min + 1);
+}
+
+// True with probability ratio
+static int rng_chance(Rng *rng, double ratio) {
+  return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0) < ratio;
+}
+
+/*
+ * ------------------------------------
+ * Writer
+ * ------------------------------------
+ * Output goes through one large buffer and straight to write(2)
+ * ------------------------------------
+ */
+#define WRITER_SIZE (1 << 20)
+
+typedef struct {
+  int fd;
+  size_t len;
+  uint64_t total; // Bytes written so far, flushed or not
+  char buf[WRITER_SIZE];
+} Writer;
+
+static void writer_flush(Writer *writer) {
+  size_t done = 0;
+  while (done < writer->len) {
+    ssize_t n = write(writer->fd, writer->buf + done, writer->len - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    done += n;
+  }
+  writer->len = 0;
+}
+
+// Room for len more bytes, len is at most WRITER_SIZE
+static char *writer_reserve(Writer *writer, size_t len) {
+  if (writer->len + len > WRITER_SIZE)
+    writer_flush(writer);
+  char *out = writer->buf + writer->len;
+  writer->len += len;
+  writer->total += len;
+  return out;
+}
+
+static void writer_put(Writer *writer, const char *data, size_t len) {
+  memcpy(writer_reserve(writer, len), data, len);
+}
+
+/*
+ * ------------------------------------
+ * Generator
+ * ------------------------------------
+ */
+#define MAX_LITERAL 4096
+#define MAX_SECTION_KEYS 1024 // Earlier keys kept per section for duplicates
+
+typedef struct {
+  size_t min;
+  size_t max;
+} Range;
+
+typedef struct {
+  uint64_t seed;
+  uint64_t size;   // Target bytes, 0 to stop after sections * keys entries
+  size_t sections; // Distinct section names, 0 for a new name every time
+  size_t keys;     // Entries per section
+  Range key_len;
+  Range val_len;
+  double comments; // Chance of a comment line before an entry
+  double crlf;     // Chance of a line ending in \r\n
+  double dups;     // Chance of an entry reusing an earlier key of its section
+} GenOptions;
+
+static const char literal_chars[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+
+// Returns where the literal landed in the writer's buffer
+static const char *put_literal(Writer *writer, Rng *rng, size_t len) {
+  char *out = writer_reserve(writer, len);
+  for (size_t i = 0; i < len; i++)
+    out[i] = literal_chars[rng_next(rng) % (sizeof(literal_chars) - 1)];
+  return out;
+}
+
+static void put_newline(Writer *writer, Rng *rng, const GenOptions *options) {
+  if (rng_chance(rng, options->crlf))
+    writer_put(writer, "\r\n", 2);
+  else
+    writer_put(writer, "\n", 1);
+}
+
+static void put_comment(Writer *writer, Rng *rng, const GenOptions *options) {
+  writer_put(writer, "; ", 2);
+  // Comments may hold any printable text, only the parser's ';' matters
+  size_t len = rng_range(rng, 8, 64);
+  char *out = writer_reserve(writer, len);
+  for (size_t i = 0; i < len; i++)
+    out[i] = (char)(' ' + rng_next(rng) % 95);
+  put_newline(writer, rng, options);
+}
+
+static void generate(Writer *writer, const GenOptions *options) {
+  Rng rng = {options->seed};
+  // Copies of the current section's keys, for duplicates
+  static char keys[MAX_SECTION_KEYS][MAX_LITERAL];
+  static size_t key_lens[MAX_SECTION_KEYS];
+  char name[32];
+
+  for (size_t section = 0;; section++) {
+    if (options->size == 0 && section == options->sections)
+      break;
+    if (options->size > 0 && writer->total >= options->size)
+      break;
+
+    size_t id = options->sections ? section % options->sections : section;
+    int len = snprintf(name, sizeof(name), "[section_%zu]", id);
+    writer_put(writer, name, len);
+    put_newline(writer, &rng, options);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < options->keys; i++) {
+      if (options->size > 0 && writer->total >= options->size)
+        break;
+      if (rng_chance(&rng, options->comments))
+        put_comment(writer, &rng, options);
+
+      if (kept > 0 && rng_chance(&rng, options->dups)) {
+        size_t pick = rng_next(&rng) % kept;
+        writer_put(writer, keys[pick], key_lens[pick]);
+      } else {
+        size_t key_len =
+            rng_range(&rng, options->key_len.min, options->key_len.max);
+        const char *key = put_literal(writer, &rng, key_len);
+        if (kept < MAX_SECTION_KEYS) {
+          memcpy(keys[kept], key, key_len);
+          key_lens[kept++] = key_len;
+        }
+      }
+
+      writer_put(writer, " = ", 3);
+      put_literal(writer, &rng,
+                  rng_range(&rng, options->val_len.min, options->val_len.max));
+      put_newline(writer, &rng, options);
+    }
+    put_newline(writer, &rng, options);
+  }
+}
+
+/*
+ * ------------------------------------
+ * Command line
+ * ------------------------------------
+ */
+static void usage(void) {
+  fprintf(stderr,
+          "Usage: gen_ini [options] [-o <output>]\n"
+          "  --seed <n>           random seed (1)\n"
+          "  --size <n>[K|M|G]    stop after this many bytes, 1K to 4G\n"
+          "  --sections <n>       distinct section names (100, 0 = unbounded)\n"
+          "  --keys <n>           entries per section (10)\n"
+          "  --key-len <min:max>  key length range (4:16)\n"
+          "  --val-len <min:max>  value length range (1:32)\n"
+          "  --comments <ratio>   comment lines per entry (0.05)\n"
+          "  --crlf <ratio>       lines ending in \\r\\n (0)\n"
+          "  --dups <ratio>       entries repeating a key of their section (0)\n"
+          "Without --size, writes sections * keys entries.\n");
+}
+
+static uint64_t parse_size(const char *arg) {
+  char *end;
+  uint64_t size = strtoull(arg, &end, 10);
+  switch (*end) {
+  case 'G':
+  case 'g':
+    size <<= 10;
+    // fall through
+  case 'M':
+  case 'm':
+    size <<= 10;
+    // fall through
+  case 'K':
+  case 'k':
+    size <<= 10;
+    end++;
+    break;
+  }
+  if (*end != '\0' || size < 1024 || size > (4ULL << 30)) {
+    fprintf(stderr, "size must be between 1K and 4G: %s\n", arg);
+    exit(EXIT_FAILURE);
+  }
+  return size;
+}
+
+static Range parse_range(const char *arg) {
+  Range range;
+  char *end;
+  range.min = strtoull(arg, &end, 10);
+  range.max = range.min;
+  if (*end == ':')
+    range.max = strtoull(end + 1, &end, 10);
+  if (*end != '\0' || range.min == 0 || range.min > range.max ||
+      range.max > MAX_LITERAL) {
+    fprintf(stderr, "length range must be min:max within 1..%d: %s\n",
+            MAX_LITERAL, arg);
+    exit(EXIT_FAILURE);
+  }
+  return range;
+}
+
+static double parse_ratio(const char *arg) {
+  char *end;
+  double ratio = strtod(arg, &end);
+  if (*end != '\0' || ratio < 0 || ratio > 1) {
+    fprintf(stderr, "ratio must be between 0 and 1: %s\n", arg);
+    exit(EXIT_FAILURE);
+  }
+  return ratio;
+}
+
+int main(int argc, char *argv[]) {
+  GenOptions options = {
+      .seed = 1,
+      .sections = 100,
+      .keys = 10,
+      .key_len = {4, 16},
+      .val_len = {1, 32},
+      .comments = 0.05,
+  };
+  const char *output = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return EXIT_FAILURE;
+    }
+    const char *value = argv[++i];
+
+    if (strcmp(arg, "--seed") == 0) {
+      options.seed = strtoull(value, NULL, 10);
+    } else if (strcmp(arg, "--size") == 0) {
+      options.size = parse_size(value);
+    } else if (strcmp(arg, "--sections") == 0) {
+      options.sections = strtoull(value, NULL, 10);
+    } else if (strcmp(arg, "--keys") == 0) {
+      options.keys = strtoull(value, NULL, 10);
+    } else if (strcmp(arg, "--key-len") == 0) {
+      options.key_len = parse_range(value);
+    } else if (strcmp(arg, "--val-len") == 0) {
+      options.val_len = parse_range(value);
+    } else if (strcmp(arg, "--comments") == 0) {
+      options.comments = parse_ratio(value);
+    } else if (strcmp(arg, "--crlf") == 0) {
+      options.crlf = parse_ratio(value);
+    } else if (strcmp(arg, "--dups") == 0) {
+      options.dups = parse_ratio(value);
+    } else if (strcmp(arg, "-o") == 0) {
+      output = value;
+    } else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (options.keys == 0 || (options.size == 0 && options.sections == 0)) {
+    fprintf(stderr, "need --keys > 0, and --sections > 0 without --size\n");
+    return EXIT_FAILURE;
+  }
+
+  static Writer writer;
+  writer.fd = STDOUT_FILENO;
+  if (output != NULL) {
+    writer.fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer.fd < 0) {
+      perror(output);
+      return EXIT_FAILURE;
+    }
+  }
+
+  generate(&writer, &options);
+  writer_flush(&writer);
+
+  if (output != NULL && close(writer.fd) != 0) {
+    perror(output);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -0,0 +1,442 @@
+#ifndef INI_H
+#define INI_H
+
+/*
+ * Public types and functions of the INI parser, implemented in main.c.
+ * Build main.c with -DINI_NO_MAIN to link it into another program.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ------------------------------------
+ * Counters
+ * ------------------------------------
+ */
+// Hot path event counts of the calling thread, only kept when main.c is
+// built with -DINI_COUNTERS, otherwise always zero
+typedef struct {
+  uint64_t read_chars;         // read_char calls
+  uint64_t whitespace_skipped; // Bytes passed over as whitespace
+  uint64_t comment_skipped;    // Bytes passed by skip_to_next_line
+  uint64_t allocs;             // allocator_alloc calls
+  uint64_t alloc_bytes;
+  uint64_t hashed_bytes;
+  uint64_t set_probes;         // Slots visited by shasht_set
+  uint64_t set_compares;       // strcmp calls in shasht_set
+  uint64_t get_probes;         // Slots visited by shasht_get and lookups
+  uint64_t get_compares;
+} IniCounters;
+
+void ini_counters_reset(void);
+IniCounters ini_counters_get(void);
+void ini_counters_print(const IniCounters *counters, FILE *out);
+
+/*
+ * ------------------------------------
+ * Trace
+ * ------------------------------------
+ */
+// Phase spans of every thread, only recorded when main.c is built with
+// -DINI_TRACE. Write them while no traced work is running.
+void ini_trace_clear(void);
+int ini_trace_write(FILE *out); // Chrome trace JSON, -1 without INI_TRACE
+
+/*
+ * ------------------------------------
+ * Latency
+ * ------------------------------------
+ */
+typedef enum {
+  INI_LATENCY_LOOKUP, // ini_get, ini_lookup and ini_lookup_hashed
+  INI_LATENCY_RELOAD, // ini_reload calls that published a new config
+  INI_LATENCY_KINDS,
+} IniLatencyKind;
+
+// Nanoseconds, merged over all threads. min, max and mean are exact, the
+// percentiles within 1/16 of the true value.
+typedef struct {
+  uint64_t count;
+  double mean;
+  uint64_t min;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+} IniLatencyStats;
+
+// Off by default, when off a lookup pays one relaxed load
+void ini_latency_enable(int enabled);
+void ini_latency_reset(void);
+int ini_latency_stats(IniLatencyKind kind, IniLatencyStats *stats);
+void ini_latency_print(FILE *out);
+
+/*
+ * ------------------------------------
+ * Allocator
+ * ------------------------------------
+ */
+// Header of each memory block, the block's memory follows it
+typedef struct AllocBlock {
+  struct AllocBlock *next;
+  size_t cap;
+} AllocBlock;
+
+typedef struct {
+  uint8_t *buffer;     // points to start of current memory block
+  size_t cap;          // capacity of current block
+  size_t offset;       // current index into current block
+  AllocBlock *head;    // first block, every block is kept until freed
+  AllocBlock *current; // block being allocated from
+  size_t limit;        // most bytes all blocks may take, 0 for no limit
+  size_t used;         // bytes taken by blocks so far
+} LinearAllocator;
+
+void allocator_init(LinearAllocator *allocator);
+int allocator_init_limit(LinearAllocator *allocator, size_t limit);
+void *allocator_alloc(LinearAllocator *allocator, size_t size);
+void allocator_reset(LinearAllocator *allocator);
+void allocator_free(LinearAllocator *allocator);
+char *str_dup(const char *c, LinearAllocator *allocator);
+
+/*
+ * ------------------------------------
+ * Hash Table
+ * ------------------------------------
+ */
+typedef struct {
+  const char *key;
+  void *val;
+} HTEntry;
+
+typedef struct {
+  HTEntry *entries;
+  size_t len;
+  size_t cap;
+  size_t grow_at;    // len at which the next insert doubles cap
+  unsigned max_load; // Percent, 50 unless set with shasht_set_max_load
+} SHashTable;
+
+SHashTable *shasht_init(LinearAllocator *allocator);
+SHashTable *shasht_init_cap(LinearAllocator *allocator, size_t cap);
+void shasht_set_max_load(SHashTable *table, unsigned percent);
+const char *shasht_set(SHashTable *table, const char *key, void *value,
+                       LinearAllocator *allocator, size_t *probes);
+void *shasht_get(SHashTable *table, char *key);
+size_t shasht_len(SHashTable *table);
+int shasht_delete(SHashTable *table, const char *key);
+void shasht_remove_at(SHashTable *table, size_t index);
+void shasht_print_debug(SHashTable *table);
+// Slot key hashes to, before any probing
+size_t shasht_home(const SHashTable *table, const char *key);
+
+typedef struct {
+  size_t cap;
+  size_t len;
+  double load;
+  double probe_mean;      // Slots past home, 0 when in the home slot
+  size_t probe_p99;
+  size_t probe_max;
+  size_t clusters;        // Runs of filled slots
+  double cluster_mean;
+  size_t cluster_max;
+  double chi_square;      // Home slots per bucket against an even spread
+  size_t chi_buckets;
+  double bytes_per_entry; // Slot array and key copies per entry
+} SHashTableStats;
+
+// Returns -1 if scratch memory can't be allocated
+int shasht_stats(const SHashTable *table, SHashTableStats *stats);
+void shasht_print_stats(const SHashTable *table, FILE *out);
+
+/*
+ * ------------------------------------
+ * INI Parser
+ * ------------------------------------
+ */
+typedef struct {
+  const char *key;
+  const char *val;
+  const char *section;
+  uint64_t hash; // Hash of val, lets diffs skip string compares
+  size_t order;  // Position in the input, later duplicates win
+} IniEntry;
+
+// Order independent 128-bit content hash, the lane-wise sum of entry hashes
+typedef struct {
+  uint64_t hi;
+  uint64_t lo;
+} IniFingerprint;
+
+// Every entry in parse order, sorted by (section, key) once parsing is done
+typedef struct {
+  IniEntry *entries;
+  size_t len;
+  size_t cap;
+  IniFingerprint fingerprint; // Kept up to date as entries come and go
+} IniEntryIndex;
+
+typedef enum {
+  INI_OK = 0,
+  INI_ERR_MEMORY, // Allocation failed or the memory budget ran out
+  INI_ERR_SYNTAX,
+  INI_ERR_LINE_TOO_LONG,
+  INI_ERR_KEY_TOO_LONG,
+  INI_ERR_TOO_MANY_SECTIONS, // Counts headers, repeats included
+  INI_ERR_TOO_MANY_ENTRIES,  // Counts assignments, repeats included
+  INI_ERR_PROBE_LIMIT,       // Hash table slots looked at while inserting
+} IniError;
+
+// Caps against pathological input, 0 for no limit
+typedef struct {
+  size_t max_line_len;
+  size_t max_key_len;
+  size_t max_sections;
+  size_t max_entries;
+  size_t max_probes;
+} IniLimits;
+
+typedef struct {
+  // IniParser state
+  const char *input;
+  size_t input_len;
+  size_t position;      // Position pointing to current char
+  size_t read_position; // Reading position in input
+  char ch;            // Current char
+  char *section_name; // Current section name
+  IniEntryIndex *index; // Optional, receives every parsed entry
+  IniError error;       // Set when parsing stopped early
+  IniLimits limits;     // SIZE_MAX where unlimited
+  size_t line_start;    // Position of the current line's first char
+  size_t sections;
+  size_t entries;
+  size_t probes;
+  int allow_truncated;      // See IniOptions
+  uint64_t section_started; // Trace timestamp, only set with INI_TRACE
+} IniParser;
+
+IniParser new_parser(const char *input, size_t input_len);
+void parser_set_limits(IniParser *parser, const IniLimits *limits);
+// Parses one line, 0 at the end of input or on error. table may be NULL.
+int parse_next(IniParser *parser, SHashTable *table, LinearAllocator *allocator);
+SHashTable *parse_ini(IniParser *parser, LinearAllocator *allocator);
+// "" for an empty file, NULL with errno set when it can't be read. The
+// length goes to *len when len isn't NULL.
+char *read_file(const char *path, LinearAllocator *allocator, size_t *len);
+const char *ini_error_str(IniError error);
+
+IniEntry new_ini_entry(const char *key, const char *val, char *section);
+int ini_index_push(IniEntryIndex *index, IniEntry entry,
+                   LinearAllocator *allocator);
+// Scratch comes from allocator, -1 when it doesn't fit
+int ini_index_sort(IniEntryIndex *index, LinearAllocator *allocator);
+int ini_fingerprint_eq(IniFingerprint a, IniFingerprint b);
+
+/*
+ * ------------------------------------
+ * Config
+ * ------------------------------------
+ */
+typedef struct {
+  LinearAllocator allocator;
+  SHashTable *table;
+  IniEntryIndex index;
+} IniConfig;
+
+typedef struct {
+  // Bytes the parse may take from malloc for the copied keys and values,
+  // table, index and the scratch for sorting it together. 0 for no limit.
+  size_t memory_budget;
+  IniLimits limits;
+  // Accept a last line cut off mid-way, e.g. a slice of a larger buffer:
+  // an unterminated header still opens its section and a key without '='
+  // is dropped. Otherwise both are INI_ERR_SYNTAX.
+  int allow_truncated;
+} IniOptions;
+
+void ini_config_init(IniConfig *config);
+// 0 on success, -1 when the file is missing, unreadable or malformed.
+// An empty file loads as an empty config. Prints nothing.
+int ini_load(IniConfig *config, const char *path);
+// Same with limits and a memory budget, which also covers the file contents
+int ini_load_opts(IniConfig *config, const char *path,
+                  const IniOptions *options);
+// Parses len bytes of input, which needn't be NUL terminated. The last line
+// may lack its newline, see IniOptions.allow_truncated for slices ending
+// mid-line. input is never written to and can be released once this returns.
+int ini_parse_buffer(IniConfig *config, const char *input, size_t len);
+IniError ini_parse_buffer_opts(IniConfig *config, const char *input,
+                               size_t len, const IniOptions *options);
+void ini_config_free(IniConfig *config);
+
+// Sections are NULL or "" for keys before the first section
+const char *ini_get(const IniConfig *config, const char *section,
+                    const char *key);
+// Same as ini_get for strings that aren't NUL terminated
+const char *ini_lookup(const IniConfig *config, const char *section,
+                       size_t section_len, const char *key, size_t key_len);
+// Skips hashing, hash is FNV-1a over "section.key" (or "key" alone)
+const char *ini_lookup_hashed(const IniConfig *config, uint64_t hash,
+                              const char *section, size_t section_len,
+                              const char *key, size_t key_len);
+// Section (may be NULL/empty) and key must be names the parser accepts,
+// otherwise both return -1
+int ini_set(IniConfig *config, const char *section, const char *key,
+            const char *value);
+int ini_delete(IniConfig *config, const char *section, const char *key);
+
+/*
+ * ------------------------------------
+ * Streaming
+ * ------------------------------------
+ */
+typedef struct {
+  IniConfig *config;
+  IniOptions options;
+  char *section;    // Current section, carried across chunks
+  char *carry;      // Trailing partial line of the last chunk
+  size_t carry_len;
+  size_t carry_cap;
+} IniStream;
+
+// Initialises config and feeds it chunk by chunk, chunks can be reused
+// as soon as ini_stream_feed returns. A key, its '=' and value must share a
+// line, so however the input is chunked the result matches ini_load.
+void ini_stream_init(IniStream *stream, IniConfig *config);
+int ini_stream_init_opts(IniStream *stream, IniConfig *config,
+                         const IniOptions *options);
+int ini_stream_feed(IniStream *stream, const char *chunk, size_t len);
+int ini_stream_finish(IniStream *stream);
+
+/*
+ * ------------------------------------
+ * Context
+ * ------------------------------------
+ */
+typedef struct {
+  IniConfig config;
+  IniOptions options;
+  IniError error;   // Why the last parse returned NULL
+  size_t table_cap; // Largest table so far, later tables start this big
+  size_t index_cap; // Same for the entry index
+} IniContext;
+
+void ini_context_init(IniContext *context);
+// The budget bounds everything the context keeps, -1 when it's too small
+int ini_context_init_opts(IniContext *context, const IniOptions *options);
+const IniConfig *ini_context_parse(IniContext *context, const char *input,
+                                   size_t len);
+void ini_context_free(IniContext *context);
+
+/*
+ * ------------------------------------
+ * Batch
+ * ------------------------------------
+ */
+typedef struct {
+  const IniEntry *entries; // Sorted by (section, key)
+  size_t len;
+  IniFingerprint fingerprint;
+  IniError error; // Entries are empty unless INI_OK
+} IniResult;
+
+typedef struct {
+  LinearAllocator *arenas; // One per worker thread, results live here
+  size_t workers;
+  IniOptions options; // memory_budget is per worker arena
+} IniBatch;
+
+// 0 on success, -1 when out of memory
+int ini_batch_init(IniBatch *batch, size_t threads);
+int ini_batch_init_opts(IniBatch *batch, size_t threads,
+                        const IniOptions *options);
+// Results stay valid until the next call on the batch or ini_batch_free
+int ini_parse_batch(IniBatch *batch, const char *const buffers[],
+                    const size_t lens[], size_t n, IniResult results[]);
+const char *ini_result_get(const IniResult *result, const char *section,
+                           const char *key);
+void ini_batch_free(IniBatch *batch);
+
+/*
+ * ------------------------------------
+ * Diff & Subscriptions
+ * ------------------------------------
+ */
+typedef enum { INI_ADDED, INI_REMOVED, INI_CHANGED } IniChangeKind;
+
+typedef struct {
+  IniChangeKind kind;
+  const IniEntry *before; // NULL when added
+  const IniEntry *after;  // NULL when removed
+} IniChange;
+
+typedef void (*IniChangeFn)(const IniChange *change, void *user);
+
+typedef struct {
+  const char *section; // NULL or "" for keys before the first section
+  const char *key;
+  IniChangeFn callback;
+  void *user;
+} IniSubscriber;
+
+typedef struct {
+  IniSubscriber *subs;
+  size_t len;
+  size_t cap;
+  int sorted;
+} IniSubscriptions;
+
+size_t ini_diff(const IniEntryIndex *before, const IniEntryIndex *after,
+                IniChangeFn fn, void *user);
+void ini_subscribe(IniSubscriptions *subs, const char *section,
+                   const char *key, IniChangeFn callback, void *user);
+void ini_subscriptions_free(IniSubscriptions *subs);
+size_t ini_notify(IniSubscriptions *subs, const IniEntryIndex *before,
+                  const IniEntryIndex *after);
+// -1 with config untouched when path is missing, malformed, empty or lacks
+// its final newline. Subscribers are called after the new config is in place.
+int ini_reload(IniConfig *config, const char *path, IniSubscriptions *subs);
+int ini_reload_opts(IniConfig *config, const char *path,
+                    IniSubscriptions *subs, const IniOptions *options);
+
+/*
+ * ------------------------------------
+ * Journal
+ * ------------------------------------
+ */
+typedef struct {
+  int fd;
+  size_t pending;    // Records written since the last fsync
+  size_t sync_every; // Batch size, 0 leaves syncing to ini_journal_sync
+  int failed;        // A torn append couldn't be cut off, appends refused
+} IniJournal;
+
+long ini_journal_open(IniJournal *journal, const char *path, IniConfig *config,
+                      size_t sync_every);
+int ini_journal_set(IniJournal *journal, IniConfig *config,
+                    const char *section, const char *key, const char *value);
+int ini_journal_delete(IniJournal *journal, IniConfig *config,
+                       const char *section, const char *key);
+int ini_journal_sync(IniJournal *journal);
+int ini_journal_close(IniJournal *journal);
+
+/*
+ * ------------------------------------
+ * Code Generation & Embedding
+ * ------------------------------------
+ */
+int ini_gen_c(const IniEntryIndex *schema, const char *prefix);
+int ini_embed(FILE *out, const IniEntryIndex *index, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef INI_HPP
+#define INI_HPP
+
+/*
+ * Header-only C++17 facade over ini.h. Link against main.c built with
+ * -DINI_NO_MAIN. Keys and values are string_views into the config's
+ * allocator, so they stay valid for as long as the Config they came from.
+ */
+
+#include "ini.h"
+
+#include <charconv>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+// Literal keys are hashed by the compiler, forced with consteval in C++20
+#if defined(__cpp_consteval)
+#define INI_CONSTEVAL consteval
+#else
+#define INI_CONSTEVAL constexpr
+#endif
+
+namespace ini {
+
+// Same FNV-1a as the C table, usable in constant expressions
+constexpr uint64_t hash_key(std::string_view s,
+                            uint64_t hash = 14695981039346656037ULL) {
+  for (char ch : s) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// A section/key pair with the table hash of "section.key" precomputed
+struct Key {
+  std::string_view section;
+  std::string_view name;
+  uint64_t hash;
+};
+
+constexpr Key key(std::string_view section, std::string_view name) {
+  uint64_t hash = hash_key(name, section.empty()
+                                     ? 14695981039346656037ULL
+                                     : hash_key(".", hash_key(section)));
+  return Key{section, name, hash};
+}
+
+namespace literals {
+
+// "http.port"_ik, the part after the first '.' is the key, no '.' means
+// a key before the first section
+INI_CONSTEVAL Key operator""_ik(const char *str, size_t len) {
+  std::string_view qualified(str, len);
+  size_t dot = qualified.find('.');
+  if (dot == std::string_view::npos)
+    return Key{{}, qualified, hash_key(qualified)};
+  return Key{qualified.substr(0, dot), qualified.substr(dot + 1),
+             hash_key(qualified)};
+}
+
+} // namespace literals
+
+// Converts a raw value, the whole string has to be consumed
+template <class T> std::optional<T> convert(std::string_view raw) {
+  if constexpr (std::is_same_v<T, std::string_view>) {
+    return raw;
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    return std::string(raw);
+  } else if constexpr (std::is_same_v<T, bool>) {
+    if (raw == "true" || raw == "1" || raw == "yes" || raw == "on")
+      return true;
+    if (raw == "false" || raw == "0" || raw == "no" || raw == "off")
+      return false;
+    return std::nullopt;
+  } else {
+    static_assert(std::is_arithmetic_v<T>, "no conversion for this type");
+    T value{};
+    const char *end = raw.data() + raw.size();
+    auto [ptr, ec] = std::from_chars(raw.data(), end, value);
+    if (ec != std::errc() || ptr != end)
+      return std::nullopt;
+    return value;
+  }
+}
+
+// Owns a parsed IniConfig, its allocator and table. Move only.
+class Config {
+public:
+  explicit Config(const char *path) {
+    if (ini_load(&config_, path) != 0)
+      throw std::runtime_error(std::string("failed to load ") + path);
+    loaded_ = true;
+  }
+  explicit Config(const std::string &path) : Config(path.c_str()) {}
+
+  // Parses from memory, input may be a slice of something larger and is
+  // not referenced afterwards
+  static Config parse(std::string_view input) {
+    IniConfig config;
+    if (ini_parse_buffer(&config, input.data(), input.size()) != 0)
+      throw std::runtime_error("failed to parse buffer");
+    return Config(config);
+  }
+
+  // Takes ownership of a config built through the C API, e.g. a stream
+  static Config adopt(IniConfig config) { return Config(config); }
+
+  Config(const Config &) = delete;
+  Config &operator=(const Config &) = delete;
+
+  Config(Config &&other) noexcept
+      : config_(other.config_), loaded_(other.loaded_) {
+    other.config_ = IniConfig{};
+    other.loaded_ = false;
+  }
+
+  Config &operator=(Config &&other) noexcept {
+    if (this != &other) {
+      reset();
+      config_ = other.config_;
+      loaded_ = other.loaded_;
+      other.config_ = IniConfig{};
+      other.loaded_ = false;
+    }
+    return *this;
+  }
+
+  ~Config() { reset(); }
+
+  // Raw value, section is empty for keys before the first section
+  std::optional<std::string_view> find(std::string_view section,
+                                       std::string_view key) const {
+    if (!loaded_)
+      return std::nullopt;
+    const char *val = ini_lookup(&config_, section.data(), section.size(),
+                                 key.data(), key.size());
+    if (val == nullptr)
+      return std::nullopt;
+    return std::string_view(val);
+  }
+
+  // Only probes and compares, the hash was computed with the key
+  std::optional<std::string_view> find(const Key &key) const {
+    if (!loaded_)
+      return std::nullopt;
+    const char *val =
+        ini_lookup_hashed(&config_, key.hash, key.section.data(),
+                          key.section.size(), key.name.data(), key.name.size());
+    if (val == nullptr)
+      return std::nullopt;
+    return std::string_view(val);
+  }
+
+  template <class T> std::optional<T> get(const Key &key) const {
+    auto raw = find(key);
+    if (!raw)
+      return std::nullopt;
+    return convert<T>(*raw);
+  }
+
+  template <class T> T get_or(const Key &key, T fallback) const {
+    return get<T>(key).value_or(fallback);
+  }
+
+  // Missing keys and values that don't convert to T are both nullopt
+  template <class T>
+  std::optional<T> get(std::string_view section, std::string_view key) const {
+    auto raw = find(section, key);
+    if (!raw)
+      return std::nullopt;
+    return convert<T>(*raw);
+  }
+
+  template <class T>
+  T get_or(std::string_view section, std::string_view key, T fallback) const {
+    return get<T>(section, key).value_or(fallback);
+  }
+
+  size_t size() const { return loaded_ ? config_.index.len : 0; }
+
+  // Escape hatch for the rest of the C API (ini_reload, journals, ...)
+  IniConfig *c_config() { return &config_; }
+  const IniConfig *c_config() const { return &config_; }
+
+private:
+  explicit Config(IniConfig config) : config_(config), loaded_(true) {}
+
+  void reset() {
+    if (loaded_)
+      ini_config_free(&config_);
+    loaded_ = false;
+  }
+
+  IniConfig config_{};
+  bool loaded_ = false;
+};
+
+} // namespace ini
+
+#endif
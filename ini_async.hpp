@@ -0,0 +1,366 @@
+#ifndef INI_ASYNC_HPP
+#define INI_ASYNC_HPP
+
+/*
+ * C++20 coroutine loader. Reads are issued on a thread pool and each chunk
+ * is fed to the streaming parser (ini_stream_*) as it arrives, with the
+ * next read already in flight, so the awaiting thread never blocks in I/O:
+ *
+ *   ini::ThreadPool pool(2);
+ *   ini::Config config = co_await ini::load_async(pool, "app.ini");
+ *
+ * ini::sync_wait runs a task to completion from non-coroutine code.
+ */
+
+#include "ini.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace ini {
+
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads = 1) {
+    for (size_t i = 0; i < (threads > 0 ? threads : 1); i++)
+      workers_.emplace_back([this] { run(); });
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread &worker : workers_)
+      worker.join();
+  }
+
+  void post(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(std::move(job));
+    }
+    ready_.notify_one();
+  }
+
+  // co_await pool.schedule() continues the coroutine on a worker
+  auto schedule() {
+    struct Awaiter {
+      ThreadPool &pool;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        pool.post([handle] { handle.resume(); });
+      }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{*this};
+  }
+
+private:
+  void run() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty())
+          return;
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> jobs_;
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+// Closes the descriptor once the loader and every pending read let go
+struct FileHandle {
+  int fd;
+  explicit FileHandle(int fd) : fd(fd) {}
+  FileHandle(const FileHandle &) = delete;
+  FileHandle &operator=(const FileHandle &) = delete;
+  ~FileHandle() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+};
+
+// A pread submitted to the pool on construction and awaited later, so the
+// caller can parse the previous chunk while it runs. The job shares the
+// buffer and the file with the op, so a pending op can be dropped at any
+// time, even on a one thread pool where the read is queued behind the
+// coroutine dropping it.
+class ReadOp {
+public:
+  // Reads up to buf.size() bytes into buf
+  ReadOp(ThreadPool &pool, std::shared_ptr<const FileHandle> file,
+         std::vector<char> buf, off_t offset)
+      : state_(std::make_shared<State>()) {
+    state_->buf = std::move(buf);
+    pool.post([state = state_, file = std::move(file), offset] {
+      state->result =
+          ::pread(file->fd, state->buf.data(), state->buf.size(), offset);
+      state->error = state->result < 0 ? errno : 0;
+      // Only a suspended waiter keeps the op alive past this exchange
+      if (state->state.exchange(Done) == Waiting)
+        state->waiter.resume();
+    });
+  }
+
+  ReadOp(const ReadOp &) = delete;
+  ReadOp &operator=(const ReadOp &) = delete;
+
+  // co_await op.wait() gives the bytes read, 0 at end of file
+  auto wait() {
+    struct Awaiter {
+      State &state;
+
+      bool await_ready() const noexcept { return state.state.load() == Done; }
+
+      bool await_suspend(std::coroutine_handle<> handle) {
+        state.waiter = handle;
+        int expected = Pending;
+        // Fails when the read finished in the meantime, resume right away
+        return state.state.compare_exchange_strong(expected, Waiting);
+      }
+
+      size_t await_resume() const {
+        if (state.result < 0)
+          throw std::system_error(state.error, std::generic_category(),
+                                  "pread");
+        return static_cast<size_t>(state.result);
+      }
+    };
+    return Awaiter{*state_};
+  }
+
+  // Only once wait() has returned
+  const char *data() const { return state_->buf.data(); }
+  std::vector<char> release_buffer() { return std::move(state_->buf); }
+
+private:
+  enum { Pending, Waiting, Done };
+
+  struct State {
+    std::atomic<int> state{Pending};
+    std::coroutine_handle<> waiter;
+    std::vector<char> buf;
+    ssize_t result = 0;
+    int error = 0;
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+// Lazy coroutine, started when awaited, resumes its awaiter when done
+template <class T> class Task {
+public:
+  struct promise_type {
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto final_suspend() noexcept {
+      struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+          return handle.promise().continuation;
+        }
+        void await_resume() const noexcept {}
+      };
+      return FinalAwaiter{};
+    }
+
+    template <class U> void return_value(U &&result) {
+      value.emplace(std::forward<U>(result));
+    }
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<> continuation) noexcept {
+    handle_.promise().continuation = continuation;
+    return handle_;
+  }
+
+  T await_resume() {
+    if (handle_.promise().error)
+      std::rethrow_exception(handle_.promise().error);
+    return std::move(*handle_.promise().value);
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+struct Latch {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+};
+
+// Signals the latch only once suspended at the end, so the waiter can
+// destroy the frame as soon as it wakes
+struct SyncWaitTask {
+  struct promise_type {
+    Latch *latch = nullptr;
+
+    SyncWaitTask get_return_object() {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto final_suspend() noexcept {
+      struct Signal {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+          Latch *latch = handle.promise().latch;
+          std::lock_guard<std::mutex> lock(latch->mutex);
+          latch->done = true;
+          latch->cv.notify_one();
+        }
+        void await_resume() const noexcept {}
+      };
+      return Signal{};
+    }
+
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <class T>
+SyncWaitTask sync_wait_run(Task<T> &task, std::optional<T> &result,
+                           std::exception_ptr &error) {
+  try {
+    result.emplace(co_await task);
+  } catch (...) {
+    error = std::current_exception();
+  }
+}
+
+} // namespace detail
+
+// Block the calling thread until task completes
+template <class T> T sync_wait(Task<T> task) {
+  std::optional<T> result;
+  std::exception_ptr error;
+  detail::Latch latch;
+
+  detail::SyncWaitTask runner = detail::sync_wait_run(task, result, error);
+  runner.handle.promise().latch = &latch;
+  runner.handle.resume();
+
+  {
+    std::unique_lock<std::mutex> lock(latch.mutex);
+    latch.cv.wait(lock, [&] { return latch.done; });
+  }
+  runner.handle.destroy();
+
+  if (error)
+    std::rethrow_exception(error);
+  return std::move(*result);
+}
+
+// Reads path in chunk_size pieces on pool, feeding each to the streaming
+// parser while the next read is in flight
+inline Task<Config> load_async(ThreadPool &pool, std::string path,
+                               size_t chunk_size = 64 * 1024) {
+  // Even open() can block, keep it off the awaiting thread
+  co_await pool.schedule();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  auto file = std::make_shared<const FileHandle>(fd);
+
+  struct Stream {
+    IniConfig config;
+    IniStream stream;
+    bool owned = true;
+    Stream() { ini_stream_init(&stream, &config); }
+    ~Stream() {
+      if (owned) {
+        ini_stream_finish(&stream);
+        ini_config_free(&config);
+      }
+    }
+  } parse;
+
+  // Two buffers take turns, one being read into while the other is parsed
+  std::vector<char> spare(chunk_size);
+  off_t offset = 0;
+
+  auto read = std::make_unique<ReadOp>(pool, file,
+                                       std::vector<char>(chunk_size), offset);
+  while (true) {
+    size_t len = co_await read->wait();
+    if (len == 0)
+      break;
+    offset += len;
+
+    // Start the next read before parsing this chunk
+    auto next = std::make_unique<ReadOp>(pool, file, std::move(spare), offset);
+    if (ini_stream_feed(&parse.stream, read->data(), len) != 0)
+      throw std::runtime_error("failed to parse " + path);
+
+    spare = read->release_buffer();
+    read = std::move(next);
+  }
+
+  if (ini_stream_finish(&parse.stream) != 0)
+    throw std::runtime_error("failed to parse " + path);
+  parse.owned = false;
+  co_return Config::adopt(parse.config);
+}
+
+} // namespace ini
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef INI_BIND_HPP
+#define INI_BIND_HPP
+
+/*
+ * C++20 struct binding. Describe a struct's fields once and load a section
+ * straight into it, without building an SHashTable:
+ *
+ *   struct Http { int port; std::string_view host; };
+ *   template <> struct ini::Binding<Http> {
+ *     static constexpr auto fields = std::tuple(
+ *         ini::field("port", &Http::port), ini::field("host", &Http::host));
+ *   };
+ *
+ *   Http http{};
+ *   ini::load_section(input, "http", http);
+ *
+ * Field names get a perfect hash found at compile time, so each key costs
+ * one hash, one slot load and one compare before the store.
+ */
+
+#include "ini.hpp"
+#include "ini_static.hpp"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+namespace ini {
+
+template <class S, class M> struct Field {
+  std::string_view name;
+  M S::*member;
+};
+
+template <class S, class M>
+constexpr Field<S, M> field(std::string_view name, M S::*member) {
+  return Field<S, M>{name, member};
+}
+
+// Specialise with a static constexpr std::tuple of fields named `fields`
+template <class T> struct Binding;
+
+namespace detail {
+
+constexpr size_t slot_of(std::string_view name, uint64_t seed, size_t mask) {
+  uint64_t hash = hash_key(name, 14695981039346656037ULL ^
+                                     (seed * 0x9e3779b97f4a7c15ULL));
+  return (hash ^ (hash >> 32)) & mask;
+}
+
+template <size_t N> constexpr size_t table_size() {
+  size_t size = 1;
+  while (size < 2 * N)
+    size *= 2;
+  return size;
+}
+
+template <size_t N> struct PerfectHash {
+  uint64_t seed = 0;
+  std::array<uint8_t, table_size<N>()> slots{}; // field index + 1, 0 empty
+  bool found = false;
+};
+
+// Tries seeds until every name lands in its own slot
+template <size_t N>
+constexpr PerfectHash<N>
+find_perfect_hash(const std::array<std::string_view, N> &names) {
+  static_assert(N < 255, "too many fields for a uint8_t slot table");
+  constexpr size_t size = table_size<N>();
+  PerfectHash<N> result;
+
+  for (uint64_t seed = 0; seed < 100000; seed++) {
+    std::array<uint8_t, size> slots{};
+    bool collision = false;
+    for (size_t i = 0; i < N && !collision; i++) {
+      size_t slot = slot_of(names[i], seed, size - 1);
+      if (slots[slot] != 0)
+        collision = true;
+      slots[slot] = static_cast<uint8_t>(i + 1);
+    }
+    if (!collision) {
+      result.seed = seed;
+      result.slots = slots;
+      result.found = true;
+      return result;
+    }
+  }
+  return result;
+}
+
+template <class T, size_t... I>
+constexpr auto field_names(std::index_sequence<I...>) {
+  return std::array<std::string_view, sizeof...(I)>{
+      std::get<I>(Binding<T>::fields).name...};
+}
+
+template <class T> struct BindingInfo {
+  static constexpr size_t count =
+      std::tuple_size_v<std::decay_t<decltype(Binding<T>::fields)>>;
+  static constexpr auto names =
+      field_names<T>(std::make_index_sequence<count>());
+  static constexpr auto hash = find_perfect_hash(names);
+  static_assert(hash.found, "no perfect hash found for the field names");
+};
+
+template <class T, size_t I> void assign_field(T &out, std::string_view raw) {
+  constexpr auto field = std::get<I>(Binding<T>::fields);
+  using Member = std::decay_t<decltype(out.*field.member)>;
+
+  auto value = convert<Member>(raw);
+  if (!value)
+    throw std::invalid_argument("invalid value for " +
+                                std::string(field.name));
+  out.*field.member = *value;
+}
+
+// One store function per field, indexed by the slot table
+template <class T, size_t... I>
+constexpr auto make_dispatch(std::index_sequence<I...>) {
+  using Store = void (*)(T &, std::string_view);
+  return std::array<Store, sizeof...(I)>{&assign_field<T, I>...};
+}
+
+} // namespace detail
+
+// Set the field for key if the struct has one, returns whether it did
+template <class T>
+bool bind_entry(T &out, std::string_view key, std::string_view raw) {
+  using Info = detail::BindingInfo<T>;
+  static constexpr auto dispatch =
+      detail::make_dispatch<T>(std::make_index_sequence<Info::count>());
+
+  size_t slot = detail::slot_of(key, Info::hash.seed, Info::hash.slots.size() - 1);
+  uint8_t index = Info::hash.slots[slot];
+  if (index == 0 || Info::names[index - 1] != key)
+    return false;
+
+  dispatch[index - 1](out, raw);
+  return true;
+}
+
+// Parse input and store every key of section into out. Unknown keys are
+// skipped, malformed input or values that don't convert throw
+// std::invalid_argument. string_view fields point into input.
+template <class T>
+size_t load_section(std::string_view input, std::string_view section,
+                    T &out) {
+  detail::Scanner scanner(input);
+  StaticEntry entry;
+  size_t stored = 0;
+
+  while (scanner.next(entry)) {
+    if (entry.section == section && bind_entry(out, entry.key, entry.value))
+      stored++;
+  }
+  return stored;
+}
+
+} // namespace ini
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef INI_STATIC_HPP
+#define INI_STATIC_HPP
+
+/*
+ * C++20 constexpr parser for INI string literals. Follows the same grammar
+ * as main.c: [section] headers, key = value with [A-Za-z0-9_] literals and
+ * ';' comments. Parsing a literal at compile time fails the build on
+ * malformed input, since the throw can't be constant evaluated.
+ *
+ *   constexpr auto defaults = ini::parse_static<"[http]\nport = 8080\n">();
+ *   static_assert(defaults.get<int>("http", "port") == 8080);
+ */
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+namespace ini {
+
+// String literal usable as a template argument
+template <size_t N> struct fixed_string {
+  char data[N]{};
+
+  constexpr fixed_string(const char (&str)[N]) {
+    for (size_t i = 0; i < N; i++)
+      data[i] = str[i];
+  }
+
+  constexpr std::string_view view() const { return {data, N - 1}; }
+};
+
+struct StaticEntry {
+  std::string_view section; // Empty before the first section
+  std::string_view key;
+  std::string_view value;
+};
+
+namespace detail {
+
+constexpr bool is_valid_char(char ch) {
+  return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ch == '_' ||
+         ('0' <= ch && ch <= '9');
+}
+
+constexpr bool is_blank(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+// Yields one entry per call, views point into the input. Works at runtime
+// too, where malformed input throws std::invalid_argument.
+class Scanner {
+public:
+  constexpr explicit Scanner(std::string_view input) : input_(input) {}
+
+  constexpr bool next(StaticEntry &out) {
+    while (true) {
+      skip_blank_lines();
+      if (pos_ >= input_.size())
+        return false;
+
+      char ch = input_[pos_];
+      if (ch == ';') {
+        skip_line();
+      } else if (ch == '[') {
+        pos_++;
+        section_ = literal();
+        if (section_.empty() || !consume(']'))
+          throw std::invalid_argument("malformed section header");
+        end_line();
+      } else if (is_valid_char(ch)) {
+        std::string_view key = literal();
+        skip_blank();
+        if (!consume('='))
+          throw std::invalid_argument("expected '=' after key");
+        skip_blank();
+        std::string_view value = literal();
+        end_line();
+        out = StaticEntry{section_, key, value};
+        return true;
+      } else {
+        throw std::invalid_argument("illegal token");
+      }
+    }
+  }
+
+  constexpr std::string_view section() const { return section_; }
+
+private:
+  constexpr std::string_view literal() {
+    size_t start = pos_;
+    while (pos_ < input_.size() && is_valid_char(input_[pos_]))
+      pos_++;
+    return input_.substr(start, pos_ - start);
+  }
+
+  constexpr bool consume(char ch) {
+    if (pos_ < input_.size() && input_[pos_] == ch) {
+      pos_++;
+      return true;
+    }
+    return false;
+  }
+
+  constexpr void skip_blank() {
+    while (pos_ < input_.size() && is_blank(input_[pos_]))
+      pos_++;
+  }
+
+  constexpr void skip_blank_lines() {
+    while (pos_ < input_.size() &&
+           (is_blank(input_[pos_]) || input_[pos_] == '\n'))
+      pos_++;
+  }
+
+  constexpr void skip_line() {
+    while (pos_ < input_.size() && input_[pos_] != '\n')
+      pos_++;
+  }
+
+  // Only blanks or a comment may follow an entry on its line
+  constexpr void end_line() {
+    skip_blank();
+    if (pos_ < input_.size() && input_[pos_] != '\n' && input_[pos_] != ';')
+      throw std::invalid_argument("unexpected text after entry");
+    skip_line();
+  }
+
+  std::string_view input_;
+  size_t pos_ = 0;
+  std::string_view section_;
+};
+
+constexpr size_t count_entries(std::string_view input) {
+  Scanner scanner(input);
+  StaticEntry entry;
+  size_t count = 0;
+  while (scanner.next(entry))
+    count++;
+  return count;
+}
+
+constexpr bool entry_less(const StaticEntry &a, const StaticEntry &b) {
+  return a.section < b.section || (a.section == b.section && a.key < b.key);
+}
+
+template <class T>
+constexpr std::optional<T> parse_integer(std::string_view raw) {
+  using U = std::make_unsigned_t<T>;
+  bool negative = false;
+  size_t i = 0;
+  if (std::is_signed_v<T> && !raw.empty() && raw[0] == '-') {
+    negative = true;
+    i = 1;
+  }
+  if (i == raw.size())
+    return std::nullopt;
+
+  // Magnitude limit, one more for the most negative value
+  U limit = static_cast<U>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+  U value = 0;
+  for (; i < raw.size(); i++) {
+    if (raw[i] < '0' || raw[i] > '9')
+      return std::nullopt;
+    U digit = static_cast<U>(raw[i] - '0');
+    if (value > (limit - digit) / 10)
+      return std::nullopt;
+    value = value * 10 + digit;
+  }
+  return negative ? static_cast<T>(U(0) - value) : static_cast<T>(value);
+}
+
+} // namespace detail
+
+// Sorted by (section, key), duplicates keep the last assignment like main.c
+template <size_t N> class StaticTable {
+public:
+  constexpr explicit StaticTable(std::string_view input) {
+    detail::Scanner scanner(input);
+    StaticEntry entry;
+    while (scanner.next(entry)) {
+      // Insertion sort, stable so a later duplicate lands after the earlier
+      size_t i = size_;
+      while (i > 0 && detail::entry_less(entry, entries_[i - 1])) {
+        entries_[i] = entries_[i - 1];
+        i--;
+      }
+      entries_[i] = entry;
+      size_++;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < size_; i++) {
+      if (out > 0 && entries_[out - 1].section == entries_[i].section &&
+          entries_[out - 1].key == entries_[i].key)
+        out--;
+      entries_[out++] = entries_[i];
+    }
+    size_ = out;
+  }
+
+  constexpr std::optional<std::string_view> find(std::string_view section,
+                                                 std::string_view key) const {
+    size_t lo = 0, hi = size_;
+    StaticEntry probe{section, key, {}};
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (detail::entry_less(entries_[mid], probe))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo < size_ && entries_[lo].section == section &&
+        entries_[lo].key == key)
+      return entries_[lo].value;
+    return std::nullopt;
+  }
+
+  // string_view, bool or integral types, all constexpr
+  template <class T>
+  constexpr std::optional<T> get(std::string_view section,
+                                 std::string_view key) const {
+    auto raw = find(section, key);
+    if (!raw)
+      return std::nullopt;
+
+    if constexpr (std::is_same_v<T, std::string_view>) {
+      return raw;
+    } else if constexpr (std::is_same_v<T, bool>) {
+      if (*raw == "true" || *raw == "1" || *raw == "yes" || *raw == "on")
+        return true;
+      if (*raw == "false" || *raw == "0" || *raw == "no" || *raw == "off")
+        return false;
+      return std::nullopt;
+    } else {
+      static_assert(std::is_integral_v<T>, "no constexpr conversion for T");
+      return detail::parse_integer<T>(*raw);
+    }
+  }
+
+  constexpr size_t size() const { return size_; }
+  constexpr const StaticEntry *begin() const { return entries_.data(); }
+  constexpr const StaticEntry *end() const { return entries_.data() + size_; }
+
+private:
+  std::array<StaticEntry, N> entries_{};
+  size_t size_ = 0;
+};
+
+// The views in the table point into the template parameter object, which
+// has static storage duration, so the result can be a constexpr variable
+template <fixed_string Source> constexpr auto parse_static() {
+  constexpr size_t count = detail::count_entries(Source.view());
+  return StaticTable<count>(Source.view());
+}
+
+} // namespace ini
+
+#endif
@@ -1,8 +1,456 @@
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ini.h"
+
+/*
+ * ------------------------------------
+ * Counters
+ * ------------------------------------
+ * Hot path event counts, compiled in with -DINI_COUNTERS and nothing at
+ * all otherwise. Per thread, so a parse reads its own counts.
+ * ------------------------------------
+ */
+#ifdef INI_COUNTERS
+static _Thread_local IniCounters counters;
+#define COUNT(field, n) (counters.field += (n))
+#else
+#define COUNT(field, n) ((void)0)
+#endif
+
+void ini_counters_reset(void) {
+#ifdef INI_COUNTERS
+  counters = (IniCounters){0};
+#endif
+}
+
+// All zero unless built with INI_COUNTERS
+IniCounters ini_counters_get(void) {
+#ifdef INI_COUNTERS
+  return counters;
+#else
+  return (IniCounters){0};
+#endif
+}
+
+void ini_counters_print(const IniCounters *c, FILE *out) {
+  fprintf(out, "=== Counters ===\n");
+  fprintf(out, "read_char calls: %llu\n", (unsigned long long)c->read_chars);
+  fprintf(out, "Whitespace skipped: %llu bytes\n",
+          (unsigned long long)c->whitespace_skipped);
+  fprintf(out, "Comments skipped: %llu bytes\n",
+          (unsigned long long)c->comment_skipped);
+  fprintf(out, "allocator_alloc: %llu calls, %llu bytes\n",
+          (unsigned long long)c->allocs, (unsigned long long)c->alloc_bytes);
+  fprintf(out, "Hashed: %llu bytes\n", (unsigned long long)c->hashed_bytes);
+  fprintf(out, "Set: %llu probes, %llu strcmp\n", (unsigned long long)c->set_probes,
+          (unsigned long long)c->set_compares);
+  fprintf(out, "Get: %llu probes, %llu compares\n",
+          (unsigned long long)c->get_probes, (unsigned long long)c->get_compares);
+  fprintf(out, "================\n");
+}
+
+/*
+ * ------------------------------------
+ * Thread Slots
+ * ------------------------------------
+ * Per-thread records that outlive their thread, for statistics merged on
+ * read. Each thread claims one slot per registry. A slot of an exited
+ * thread keeps its data and is handed to the next thread that claims
+ * one, so threads coming and going don't grow memory. Slots are never
+ * freed or unlinked, readers walk them without a lock.
+ * ------------------------------------
+ */
+// Header of every slot, the first member of the record that embeds it
+typedef struct ThreadSlot {
+  struct ThreadSlot *next;
+  atomic_int in_use;
+} ThreadSlot;
+
+typedef struct {
+  size_t size; // Of the record embedding the ThreadSlot
+  _Atomic(ThreadSlot *) slots;
+  atomic_int key_ready;
+  pthread_key_t key; // Releases the slot on thread exit
+} SlotRegistry;
+
+#define SLOT_REGISTRY(type) {sizeof(type), NULL, 0, 0}
+
+static pthread_mutex_t slot_key_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void slot_release(void *slot) {
+  atomic_store(&((ThreadSlot *)slot)->in_use, 0);
+}
+
+// A zeroed new slot or one left by an exited thread, NULL when out of
+// memory. Call once per thread and keep the result thread-local.
+static ThreadSlot *slot_claim(SlotRegistry *registry) {
+  if (!atomic_load(&registry->key_ready)) {
+    pthread_mutex_lock(&slot_key_lock);
+    if (!atomic_load(&registry->key_ready)) {
+      pthread_key_create(&registry->key, slot_release);
+      atomic_store(&registry->key_ready, 1);
+    }
+    pthread_mutex_unlock(&slot_key_lock);
+  }
+
+  ThreadSlot *slot = atomic_load(&registry->slots);
+  for (; slot != NULL; slot = slot->next) {
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&slot->in_use, &expected, 1))
+      break;
+  }
+  if (slot == NULL) {
+    slot = calloc(1, registry->size);
+    if (slot == NULL)
+      return NULL;
+    atomic_store(&slot->in_use, 1);
+    slot->next = atomic_load(&registry->slots);
+    while (!atomic_compare_exchange_weak(&registry->slots, &slot->next, slot)) { }
+  }
+
+  pthread_setspecific(registry->key, slot);
+  return slot;
+}
+
+static ThreadSlot *slot_first(SlotRegistry *registry) {
+  return atomic_load(&registry->slots);
+}
+
+/*
+ * ------------------------------------
+ * Trace
+ * ------------------------------------
+ * Phase spans for Chrome's trace viewer and Perfetto, compiled in with
+ * -DINI_TRACE and nothing at all otherwise. Each thread writes complete
+ * events to its own ring, a thread slot, so recording never takes a
+ * lock and a busy batch keeps at most one ring per worker.
+ * ------------------------------------
+ */
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+#ifdef INI_TRACE
+#define TRACE_RING_SIZE (1 << 16) // Events per thread, oldest overwritten
+
+typedef struct {
+  const char *name; // Static string, outlives the ring
+  uint64_t start;   // CLOCK_MONOTONIC ns
+  uint64_t dur;
+  uint32_t tid;
+} TraceEvent;
+
+typedef struct {
+  ThreadSlot slot;
+  uint32_t tid;
+  atomic_size_t head; // Events ever written, the owner is the only writer
+  TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static SlotRegistry trace_rings = SLOT_REGISTRY(TraceRing);
+static atomic_uint trace_next_tid = 1;
+static _Thread_local TraceRing *trace_ring;
+
+// A reused ring keeps the events of its last thread under their old tid
+static TraceRing *trace_claim(void) {
+  TraceRing *ring = (TraceRing *)slot_claim(&trace_rings);
+  if (ring != NULL)
+    ring->tid = atomic_fetch_add(&trace_next_tid, 1);
+  return ring;
+}
+
+static void trace_span(const char *name, uint64_t start) {
+  uint64_t end = monotonic_ns();
+  if (trace_ring == NULL && (trace_ring = trace_claim()) == NULL)
+    return;
+
+  size_t head = atomic_load_explicit(&trace_ring->head, memory_order_relaxed);
+  trace_ring->events[head % TRACE_RING_SIZE] =
+      (TraceEvent){name, start, end - start, trace_ring->tid};
+  // Publishes the event to ini_trace_write
+  atomic_store_explicit(&trace_ring->head, head + 1, memory_order_release);
+}
+
+#define TRACE_START(var) uint64_t var = monotonic_ns()
+#define TRACE_END(name, var) trace_span(name, var)
+#else
+#define TRACE_START(var) ((void)0)
+#define TRACE_END(name, var) ((void)0)
+#endif
+
+// Drops recorded events, call while no traced work is running
+void ini_trace_clear(void) {
+#ifdef INI_TRACE
+  for (ThreadSlot *slot = slot_first(&trace_rings); slot != NULL;
+       slot = slot->next) {
+    TraceRing *ring = (TraceRing *)slot;
+    atomic_store(&ring->head, 0);
+  }
+#endif
+}
+
+// Writes the recorded spans as Chrome trace JSON, call while no traced work
+// is running. -1 when built without INI_TRACE or the write fails.
+int ini_trace_write(FILE *out) {
+#ifdef INI_TRACE
+  // Timestamps start at the first event, easier to read than uptime
+  uint64_t base = UINT64_MAX;
+  for (ThreadSlot *slot = slot_first(&trace_rings); slot != NULL;
+       slot = slot->next) {
+    TraceRing *ring = (TraceRing *)slot;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (size_t i = first; i < head; i++) {
+      if (ring->events[i % TRACE_RING_SIZE].start < base)
+        base = ring->events[i % TRACE_RING_SIZE].start;
+    }
+  }
+
+  const char *sep = "\n";
+  fprintf(out, "{\"traceEvents\": [");
+  for (ThreadSlot *slot = slot_first(&trace_rings); slot != NULL;
+       slot = slot->next) {
+    TraceRing *ring = (TraceRing *)slot;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (size_t i = first; i < head; i++) {
+      const TraceEvent *event = &ring->events[i % TRACE_RING_SIZE];
+      fprintf(out,
+              "%s  {\"name\": \"%s\", \"cat\": \"ini\", \"ph\": \"X\", "
+              "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u}",
+              sep, event->name, (event->start - base) / 1e3, event->dur / 1e3,
+              event->tid);
+      sep = ",\n";
+    }
+  }
+  fprintf(out, "\n], \"displayTimeUnit\": \"ns\"}\n");
+  return ferror(out) ? -1 : 0;
+#else
+  (void)out;
+  return -1;
+#endif
+}
+
+/*
+ * ------------------------------------
+ * Probes
+ * ------------------------------------
+ * USDT probes of the "ini" provider for bpftrace and friends, e.g.
+ *   bpftrace -e 'usdt:./ini_parser:ini:lookup_miss { printf("%s\n", str(arg2)); }'
+ * Each is a nop until a tracer attaches. Without <sys/sdt.h> (systemtap's
+ * sdt headers) or with -DINI_NO_PROBES they compile to nothing.
+ *
+ *   parse_start(input, len)           parse_done(entries, IniError)
+ *   section_enter(name, position)     entry_insert(section, key, val)
+ *   table_resize(old cap, cap, len)   lookup_miss(section, len, key, len)
+ *   reload_publish(path, entries, changes)
+ * ------------------------------------
+ */
+#if defined(__has_include) && !defined(INI_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define INI_HAVE_SDT
+#endif
+#endif
+
+#ifdef INI_HAVE_SDT
+#define PROBE2(name, a, b) DTRACE_PROBE2(ini, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(ini, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(ini, name, a, b, c, d)
+#else
+// sizeof keeps the arguments used without evaluating them
+#define PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c) (PROBE2(name, a, b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d) (PROBE3(name, a, b, c), (void)sizeof(d))
+#endif
+
+/*
+ * ------------------------------------
+ * Latency
+ * ------------------------------------
+ * Log-linear histograms of lookup and reload times, off until
+ * ini_latency_enable. Every power of two is split into 16 buckets, so a
+ * value is recorded within 1/16 of itself. Each thread counts into its
+ * own histograms, a thread slot, and readers merge them, so recording
+ * never contends.
+ * ------------------------------------
+ */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+typedef struct {
+  atomic_uint_fast64_t counts[LATENCY_BUCKETS];
+  atomic_uint_fast64_t total; // Sum of the recorded ns
+  atomic_uint_fast64_t min;   // Smallest ns + 1, 0 before the first sample
+  atomic_uint_fast64_t max;   // Largest ns
+} LatencyHistogram;
+
+typedef struct {
+  ThreadSlot slot;
+  LatencyHistogram histograms[INI_LATENCY_KINDS];
+} LatencyThread;
+
+static atomic_int latency_enabled;
+static SlotRegistry latency_threads = SLOT_REGISTRY(LatencyThread);
+static _Thread_local LatencyThread *latency_thread;
+
+static size_t latency_bucket(uint64_t ns) {
+  if (ns < LATENCY_SUB)
+    return ns;
+  int exp = 63 - __builtin_clzll(ns);
+  return (size_t)(exp - LATENCY_SUB_BITS + 1) * LATENCY_SUB +
+         ((ns >> (exp - LATENCY_SUB_BITS)) & (LATENCY_SUB - 1));
+}
+
+// Largest value that lands in bucket
+static uint64_t latency_bucket_high(size_t bucket) {
+  if (bucket < LATENCY_SUB)
+    return bucket;
+  int shift = bucket / LATENCY_SUB - 1;
+  uint64_t low = (uint64_t)(LATENCY_SUB + bucket % LATENCY_SUB) << shift;
+  return low + ((uint64_t)1 << shift) - 1;
+}
+
+// 0 when disabled, pass it to latency_end either way
+static inline uint64_t latency_start(void) {
+  if (!atomic_load_explicit(&latency_enabled, memory_order_relaxed))
+    return 0;
+  return monotonic_ns();
+}
+
+static inline void latency_end(IniLatencyKind kind, uint64_t start) {
+  if (start == 0)
+    return;
+  uint64_t ns = monotonic_ns() - start;
+  if (latency_thread == NULL &&
+      (latency_thread = (LatencyThread *)slot_claim(&latency_threads)) == NULL)
+    return;
+
+  // Only the owning thread writes, relaxed loads and stores are enough
+  LatencyHistogram *histogram = &latency_thread->histograms[kind];
+  atomic_uint_fast64_t *count = &histogram->counts[latency_bucket(ns)];
+  atomic_store_explicit(count,
+                        atomic_load_explicit(count, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+  atomic_store_explicit(
+      &histogram->total,
+      atomic_load_explicit(&histogram->total, memory_order_relaxed) + ns,
+      memory_order_relaxed);
+  uint64_t min = atomic_load_explicit(&histogram->min, memory_order_relaxed);
+  if (min == 0 || ns + 1 < min)
+    atomic_store_explicit(&histogram->min, ns + 1, memory_order_relaxed);
+  if (ns > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+    atomic_store_explicit(&histogram->max, ns, memory_order_relaxed);
+}
+
+void ini_latency_enable(int enabled) {
+  atomic_store(&latency_enabled, enabled != 0);
+}
+
+// Counts recorded while this runs may be lost
+void ini_latency_reset(void) {
+  for (ThreadSlot *slot = slot_first(&latency_threads); slot != NULL;
+       slot = slot->next) {
+    LatencyThread *thread = (LatencyThread *)slot;
+    for (size_t kind = 0; kind < INI_LATENCY_KINDS; kind++) {
+      LatencyHistogram *histogram = &thread->histograms[kind];
+      for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+        atomic_store_explicit(&histogram->counts[i], 0, memory_order_relaxed);
+      atomic_store_explicit(&histogram->total, 0, memory_order_relaxed);
+      atomic_store_explicit(&histogram->min, 0, memory_order_relaxed);
+      atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+    }
+  }
+}
+
+// Merges the histograms of every thread. min, max and mean are exact, the
+// percentiles are bucket upper bounds kept within [min, max].
+int ini_latency_stats(IniLatencyKind kind, IniLatencyStats *stats) {
+  if (kind >= INI_LATENCY_KINDS)
+    return -1;
+
+  uint64_t *counts = calloc(LATENCY_BUCKETS, sizeof(uint64_t));
+  if (counts == NULL)
+    return -1;
+  uint64_t total = 0, min = 0;
+  *stats = (IniLatencyStats){0};
+  for (ThreadSlot *slot = slot_first(&latency_threads); slot != NULL;
+       slot = slot->next) {
+    LatencyThread *thread = (LatencyThread *)slot;
+    LatencyHistogram *histogram = &thread->histograms[kind];
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+      uint64_t n =
+          atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+      counts[i] += n;
+      stats->count += n;
+    }
+    total += atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    uint64_t thread_min =
+        atomic_load_explicit(&histogram->min, memory_order_relaxed);
+    if (thread_min != 0 && (min == 0 || thread_min < min))
+      min = thread_min;
+    uint64_t thread_max =
+        atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    if (thread_max > stats->max)
+      stats->max = thread_max;
+  }
+
+  if (stats->count > 0) {
+    stats->mean = (double)total / stats->count;
+    stats->min = min > 0 ? min - 1 : 0;
+    const double ranks[] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t *values[] = {&stats->p50, &stats->p90, &stats->p99, &stats->p999};
+    size_t next = 0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+      if (counts[i] == 0)
+        continue;
+      uint64_t high = latency_bucket_high(i);
+      if (high < stats->min)
+        high = stats->min;
+      if (high > stats->max)
+        high = stats->max;
+      seen += counts[i];
+      while (next < 4 && seen >= ceil(ranks[next] * stats->count))
+        *values[next++] = high;
+    }
+  }
+  free(counts);
+  return 0;
+}
+
+void ini_latency_print(FILE *out) {
+  const char *names[INI_LATENCY_KINDS] = {"lookup", "reload"};
+  fprintf(out, "=== Latency (ns) ===\n");
+  for (size_t kind = 0; kind < INI_LATENCY_KINDS; kind++) {
+    IniLatencyStats stats;
+    if (ini_latency_stats(kind, &stats) != 0)
+      continue;
+    fprintf(out,
+            "%s: %llu samples, mean %.0f, min %llu, p50 %llu, p90 %llu, "
+            "p99 %llu, p99.9 %llu, max %llu\n",
+            names[kind], (unsigned long long)stats.count, stats.mean,
+            (unsigned long long)stats.min, (unsigned long long)stats.p50,
+            (unsigned long long)stats.p90, (unsigned long long)stats.p99,
+            (unsigned long long)stats.p999, (unsigned long long)stats.max);
+  }
+  fprintf(out, "====================\n");
+}
 
 /*
  * ------------------------------------
@@ -12,29 +460,79 @@
  * ------------------------------------
  */
 
-#define INITIAL_ALLOC_SIZE 2048
+#define INITIAL_ALLOC_SIZE 8192
+
+// Moves to the next block when the current one is full. Blocks kept from
+// before a reset are reused when big enough, otherwise a new block twice
+// the size of the last is linked in ahead of them.
+static int allocator_next_block(LinearAllocator *allocator, size_t size) {
+  AllocBlock *block =
+      allocator->current ? allocator->current->next : allocator->head;
+
+  if (block == NULL || block->cap < size) {
+    size_t cap = allocator->cap ? allocator->cap * 2 : INITIAL_ALLOC_SIZE;
+    while (cap < size)
+      cap *= 2;
+
+    // Under a limit the last block shrinks to whatever is left of it
+    if (allocator->limit > 0) {
+      size_t left = allocator->limit - allocator->used;
+      if (left < sizeof(AllocBlock) + size)
+        return 0;
+      if (cap > left - sizeof(AllocBlock))
+        cap = left - sizeof(AllocBlock);
+    }
 
-typedef struct {
-  uint8_t *buffer; // points to start of memory block
-  size_t cap;      // capacity of allocator
-  size_t offset;   // current index into memory block
-} LinearAllocator;
+    AllocBlock *fresh = malloc(sizeof(AllocBlock) + cap);
+    if (fresh == NULL)
+      return 0;
+    allocator->used += sizeof(AllocBlock) + cap;
+    fresh->cap = cap;
+    fresh->next = block;
+    if (allocator->current)
+      allocator->current->next = fresh;
+    else
+      allocator->head = fresh;
+    block = fresh;
+  }
+
+  allocator->current = block;
+  allocator->buffer = (uint8_t *)(block + 1);
+  allocator->cap = block->cap;
+  allocator->offset = 0;
+  return 1;
+}
 
 void allocator_init(LinearAllocator *allocator) {
-  allocator->buffer = malloc(INITIAL_ALLOC_SIZE);
-  allocator->cap = INITIAL_ALLOC_SIZE;
+  allocator_init_limit(allocator, 0);
+}
+
+// limit caps the bytes malloc'd for blocks, headers included, 0 for none.
+// Returns 0 when even the first block doesn't fit.
+int allocator_init_limit(LinearAllocator *allocator, size_t limit) {
+  allocator->head = NULL;
+  allocator->current = NULL;
+  allocator->buffer = NULL;
+  allocator->cap = 0;
   allocator->offset = 0;
+  allocator->limit = limit;
+  allocator->used = 0;
+  return allocator_next_block(allocator, 1);
 }
 
 void *allocator_alloc(LinearAllocator *allocator, size_t size) {
+  COUNT(allocs, 1);
+  COUNT(alloc_bytes, size);
   // Align the current offset to the next multiple of the alignment
   size_t alignment = 8;
   size_t aligned_offset =
       (allocator->offset + (alignment - 1)) & ~(alignment - 1);
 
-  // Check for capacity
+  // Check for capacity, moving on to another block if needed
   if (aligned_offset + size > allocator->cap) {
-    return NULL; // failed to alloaligned_offset
+    if (!allocator_next_block(allocator, size))
+      return NULL; // failed to allocate
+    aligned_offset = 0;
   }
   // Start of memory free
   void *ptr = allocator->buffer + aligned_offset;
@@ -44,14 +542,31 @@ void *allocator_alloc(LinearAllocator *allocator, size_t size) {
   return ptr;
 }
 
-// All memory is void and free to be overriden
-void allocator_reset(LinearAllocator *allocator) { allocator->offset = 0; }
+// All memory is void and free to be overriden, blocks are kept for reuse
+void allocator_reset(LinearAllocator *allocator) {
+  if (allocator->head == NULL)
+    return;
+
+  allocator->current = allocator->head;
+  allocator->buffer = (uint8_t *)(allocator->head + 1);
+  allocator->cap = allocator->head->cap;
+  allocator->offset = 0;
+}
 
 void allocator_free(LinearAllocator *allocator) {
-  free(allocator->buffer);
+  AllocBlock *block = allocator->head;
+  while (block != NULL) {
+    AllocBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+
+  allocator->head = NULL;
+  allocator->current = NULL;
   allocator->buffer = NULL;
   allocator->cap = 0;
   allocator->offset = 0;
+  allocator->used = 0;
 }
 
 /*
@@ -62,35 +577,41 @@ void allocator_free(LinearAllocator *allocator) {
  * ------------------------------------
  */
 
-#define MAX_TABLE_SIZE 64
+#define INITIAL_TABLE_SIZE 64
 #define FNV_OFFSET 14695981039346656037UL
 #define FNV_PRIME 1099511628211UL
 
-typedef struct {
-  const char *key;
-  void *val;
-} HTEntry;
-
-typedef struct {
-  HTEntry *entries;
-  size_t len;
-  size_t cap;
-} SHashTable;
-
-SHashTable *shasht_init(LinearAllocator *allocator) {
+// cap must be a power of two, NULL when the allocator is out of memory
+SHashTable *shasht_init_cap(LinearAllocator *allocator, size_t cap) {
   SHashTable *table = allocator_alloc(allocator, sizeof(SHashTable));
   if (table == NULL)
-    exit(1);
+    return NULL;
 
-  table->cap = MAX_TABLE_SIZE;
+  table->cap = cap;
   table->len = 0;
+  table->max_load = 50;
+  table->grow_at = cap / 2;
   table->entries = allocator_alloc(allocator, table->cap * sizeof(HTEntry));
   if (table->entries == NULL)
-    exit(1);
+    return NULL;
 
   return table;
 }
 
+SHashTable *shasht_init(LinearAllocator *allocator) {
+  return shasht_init_cap(allocator, INITIAL_TABLE_SIZE);
+}
+
+// Percent of slots filled before the table doubles, 10 to 95
+void shasht_set_max_load(SHashTable *table, unsigned percent) {
+  if (percent < 10)
+    percent = 10;
+  if (percent > 95)
+    percent = 95;
+  table->max_load = percent;
+  table->grow_at = table->cap * percent / 100;
+}
+
 void shasht_destroy(SHashTable *table) {
   for (size_t i = 0; i < table->cap; i++) {
     free((void *)table->entries[i].key);
@@ -104,56 +625,106 @@ void shasht_destroy(SHashTable *table) {
 // https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function
 static uint64_t hash_key(const char *key) {
   uint64_t hash = FNV_OFFSET;
-  for (const char *p = key; *p; p++) {
+  const char *p = key;
+  for (; *p; p++) {
     hash ^= (uint64_t)(unsigned char)(*p);
     hash *= FNV_PRIME;
   }
+  COUNT(hashed_bytes, p - key);
+
+  return hash;
+}
+
+// Continue an FNV-1a hash over len more bytes
+static uint64_t hash_bytes(uint64_t hash, const char *data, size_t len) {
+  COUNT(hashed_bytes, len);
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint64_t)(unsigned char)data[i];
+    hash *= FNV_PRIME;
+  }
 
   return hash;
 }
 
+// NULL when the allocator is out of memory
 char *str_dup(const char *c, LinearAllocator *allocator) {
   char *dup = allocator_alloc(allocator, strlen(c) + 1);
-  if (!dup) {
-    fprintf(stderr, "Failed to allocate memory for string duplication\n");
-    exit(EXIT_FAILURE);
-  }
+  if (!dup)
+    return NULL;
   strcpy(dup, c);
   return dup;
 }
-static const char *shasht_set(SHashTable *table, const char *key, void *value,
-                              LinearAllocator *allocator) {
-  assert(value != NULL);
+// Double the capacity and rehash, the old array stays in the allocator.
+// Returns 0 and leaves the table as it was when out of memory.
+static int shasht_grow(SHashTable *table, LinearAllocator *allocator) {
+  TRACE_START(start);
+  size_t cap = table->cap * 2;
+  HTEntry *entries = allocator_alloc(allocator, cap * sizeof(HTEntry));
+  if (entries == NULL)
+    return 0;
 
-  if (table->len >= table->cap / 2) {
-    fprintf(stderr, "Need to implement resizing as Hash table has filled up\n");
-    exit(EXIT_FAILURE);
+  for (size_t i = 0; i < table->cap; i++) {
+    HTEntry *entry = &table->entries[i];
+    if (entry->key == NULL)
+      continue;
+
+    size_t index = hash_key(entry->key) & (cap - 1);
+    while (entries[index].key != NULL)
+      index = (index + 1) & (cap - 1);
+    entries[index] = *entry;
   }
 
+  PROBE3(table_resize, table->cap, cap, table->len);
+  table->entries = entries;
+  table->cap = cap;
+  table->grow_at = cap * table->max_load / 100;
+  TRACE_END("table grow", start);
+  return 1;
+}
+
+// Returns the stored key, NULL when out of memory. Adds the slots looked at
+// to *probes when probes isn't NULL.
+const char *shasht_set(SHashTable *table, const char *key, void *value,
+                       LinearAllocator *allocator, size_t *probes) {
+  assert(value != NULL);
+
+  if (table->len >= table->grow_at && !shasht_grow(table, allocator))
+    return NULL;
+
   uint64_t hash = hash_key(key);
   // Normalise hash to capacity of table
   size_t index = (hash & (table->cap - 1));
-
+  size_t probed = 1;
 
   // Look for the key in the array, loop until
   // we find an empty slot, in which case - we
   // could not find the key requested.
   while (table->entries[index].key != NULL) {
+    COUNT(set_compares, 1);
     if (strcmp(key, table->entries[index].key) == 0) {
       // TODO: Found existing key, update value
       table->entries[index].val = value;
+      COUNT(set_probes, probed);
+      if (probes != NULL)
+        *probes += probed;
       return table->entries[index].key;
     }
 
     index++;
+    probed++;
 
     // Wrap around array
     if (index >= table->cap) {
       index = 0;
     }
   }
+  COUNT(set_probes, probed);
+  if (probes != NULL)
+    *probes += probed;
   // Insert new key value pair
   key = str_dup(key, allocator);
+  if (key == NULL)
+    return NULL;
   table->len += 1;
 
   table->entries[index].key = key;
@@ -170,10 +741,13 @@ void *shasht_get(SHashTable *table, char *key) {
   // Look for the key in the array, loop until
   // we find an empty slot, in which case - we
   // could not find the key requested.
+  COUNT(get_probes, 1);
   while (table->entries[index].key != NULL) {
-    if (strcmp(key, table->entries->key) == 0) {
+    COUNT(get_compares, 1);
+    if (strcmp(key, table->entries[index].key) == 0) {
       return table->entries[index].val;
     }
+    COUNT(get_probes, 1);
 
     index++;
 
@@ -207,8 +781,158 @@ void shasht_print_debug(SHashTable *table) {
   }
   printf("=============================\n");
 }
-// TODO: Delete from hash table function
-// int shasht_delete(SHashTable *table) { }
+
+// Slot key hashes to, before any probing
+size_t shasht_home(const SHashTable *table, const char *key) {
+  return hash_key(key) & (table->cap - 1);
+}
+
+// Probe length is how far an entry sits past its home slot. Clusters are
+// runs of filled slots, the chi-square compares how many home slots fall
+// in each of stats->chi_buckets equal ranges against an even spread.
+int shasht_stats(const SHashTable *table, SHashTableStats *stats) {
+  size_t mask = table->cap - 1;
+  *stats = (SHashTableStats){.cap = table->cap, .len = table->len};
+  if (table->len == 0)
+    return 0;
+
+  // At least ~5 expected per range, and a power of two to mask with
+  size_t buckets = 1;
+  while (buckets * 2 <= table->len / 5 && buckets * 2 <= table->cap)
+    buckets *= 2;
+
+  size_t *distances = calloc(table->cap, sizeof(size_t));
+  size_t *homes = calloc(buckets, sizeof(size_t));
+  if (distances == NULL || homes == NULL) {
+    free(distances);
+    free(homes);
+    return -1;
+  }
+
+  size_t total = 0, key_bytes = 0;
+  for (size_t i = 0; i < table->cap; i++) {
+    const char *key = table->entries[i].key;
+    if (key == NULL)
+      continue;
+    uint64_t hash = hash_key(key);
+    size_t distance = (i - (hash & mask)) & mask;
+    distances[distance]++;
+    total += distance;
+    if (distance > stats->probe_max)
+      stats->probe_max = distance;
+    homes[(hash & mask) * buckets / table->cap]++;
+    key_bytes += strlen(key) + 1;
+  }
+
+  stats->load = (double)table->len / table->cap;
+  stats->probe_mean = (double)total / table->len;
+  size_t seen = 0, rank = (table->len * 99 + 99) / 100;
+  for (size_t d = 0; d <= stats->probe_max; d++) {
+    seen += distances[d];
+    if (seen >= rank) {
+      stats->probe_p99 = d;
+      break;
+    }
+  }
+
+  // Walk from an empty slot so no cluster is split by the wrap around
+  size_t start = 0;
+  while (table->entries[start].key != NULL)
+    start++;
+  size_t run = 0, cluster_slots = 0;
+  for (size_t n = 1; n <= table->cap; n++) {
+    if (table->entries[(start + n) & mask].key != NULL) {
+      run++;
+      continue;
+    }
+    if (run > 0) {
+      stats->clusters++;
+      cluster_slots += run;
+      if (run > stats->cluster_max)
+        stats->cluster_max = run;
+    }
+    run = 0;
+  }
+  stats->cluster_mean = stats->clusters ? (double)cluster_slots / stats->clusters : 0;
+
+  double expected = (double)table->len / buckets;
+  for (size_t b = 0; b < buckets; b++)
+    stats->chi_square += (homes[b] - expected) * (homes[b] - expected) / expected;
+  stats->chi_buckets = buckets;
+
+  // The slot array and key copies, values belong to the caller
+  stats->bytes_per_entry =
+      (double)(table->cap * sizeof(HTEntry) + key_bytes) / table->len;
+
+  free(distances);
+  free(homes);
+  return 0;
+}
+
+void shasht_print_stats(const SHashTable *table, FILE *out) {
+  SHashTableStats stats;
+  if (shasht_stats(table, &stats) != 0) {
+    fprintf(out, "Failed to allocate memory for table stats\n");
+    return;
+  }
+
+  // Chi-square has buckets - 1 degrees of freedom, so with a uniform hash
+  // it lands near that and z within a few units of 0
+  size_t df = stats.chi_buckets - 1;
+  double z = df > 0 ? (stats.chi_square - df) / sqrt(2.0 * df) : 0;
+
+  fprintf(out, "=== Hash Table Stats ===\n");
+  fprintf(out, "Capacity: %zu\n", stats.cap);
+  fprintf(out, "Entries: %zu\n", stats.len);
+  fprintf(out, "Load Factor: %.2f\n", stats.load);
+  fprintf(out, "Probe Length: mean %.3f, p99 %zu, max %zu\n", stats.probe_mean,
+          stats.probe_p99, stats.probe_max);
+  fprintf(out, "Clusters: %zu, mean %.2f, max %zu slots\n", stats.clusters,
+          stats.cluster_mean, stats.cluster_max);
+  if (stats.chi_buckets > 1)
+    fprintf(out, "Chi-Square: %.1f over %zu buckets (z %.2f)\n",
+            stats.chi_square, stats.chi_buckets, z);
+  else
+    fprintf(out, "Chi-Square: too few entries\n");
+  fprintf(out, "Bytes per Entry: %.1f\n", stats.bytes_per_entry);
+  fprintf(out, "========================\n");
+}
+
+// Remove the entry in slot index, shifting back any entries after it in the
+// same probe run so lookups never stop early at the new hole
+void shasht_remove_at(SHashTable *table, size_t index) {
+  size_t hole = index;
+  size_t next = (hole + 1) & (table->cap - 1);
+
+  while (table->entries[next].key != NULL) {
+    size_t home = hash_key(table->entries[next].key) & (table->cap - 1);
+    // Distance from home must cover the hole for the entry to move into it
+    if (((next - home) & (table->cap - 1)) >= ((next - hole) & (table->cap - 1))) {
+      table->entries[hole] = table->entries[next];
+      hole = next;
+    }
+    next = (next + 1) & (table->cap - 1);
+  }
+
+  table->entries[hole].key = NULL;
+  table->entries[hole].val = NULL;
+  table->len -= 1;
+}
+
+int shasht_delete(SHashTable *table, const char *key) {
+  size_t index = hash_key(key) & (table->cap - 1);
+
+  while (table->entries[index].key != NULL) {
+    if (strcmp(key, table->entries[index].key) == 0) {
+      shasht_remove_at(table, index);
+      return 1;
+    }
+
+    index = (index + 1) & (table->cap - 1);
+  }
+
+  return 0;
+}
 
 /*
  * ------------------------------------
@@ -218,32 +942,131 @@ void shasht_print_debug(SHashTable *table) {
  * values while ignoring comments
  * ------------------------------------
  */
-typedef struct {
-  const char *key;
-  const char *val;
-  const char *section;
-} IniEntry;
-
-typedef struct {
-  // IniParser state
-  const char *input;
-  int input_len;
-  int position;       // Position pointing to current char
-  int read_position;  // Reading position in input
-  char ch;            // Current char
-  char *section_name; // Current section name
-} IniParser;
+// Set once read_position passes input_len. A '\0' byte inside the input
+// also stops the parse, as INI_ERR_SYNTAX, so it can't pass for the end.
+#define INI_EOF '\0'
 
 IniEntry new_ini_entry(const char *key, const char *val, char *section) {
-  IniEntry entry = {.key = key, .val = val, .section = section};
+  IniEntry entry = {
+      .key = key, .val = val, .section = section, .hash = hash_key(val)};
   return entry;
 }
 
-IniParser new_parser(const char *input, int input_len) {
-  IniParser parser = {input, input_len, 0, 1, input[0], 0};
+// Final mix so that summed lanes don't keep FNV's weak high bits
+static uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Two differently seeded FNV-1a lanes over section, key and value
+static IniFingerprint entry_fingerprint(const IniEntry *entry) {
+  const char *parts[3] = {entry->section ? entry->section : "", entry->key,
+                          entry->val};
+  uint64_t lo = FNV_OFFSET;
+  uint64_t hi = FNV_OFFSET ^ 0x9e3779b97f4a7c15ULL;
+
+  for (int i = 0; i < 3; i++) {
+    for (const char *p = parts[i]; *p; p++) {
+      lo = (lo ^ (unsigned char)*p) * FNV_PRIME;
+      hi = (hi ^ (unsigned char)*p) * FNV_PRIME;
+    }
+    // Separator so ("ab", "c") and ("a", "bc") hash differently
+    lo = (lo ^ 0x1f) * FNV_PRIME;
+    hi = (hi ^ 0x1f) * FNV_PRIME;
+  }
+
+  IniFingerprint fp = {mix64(hi), mix64(lo)};
+  return fp;
+}
+
+static void fingerprint_add(IniFingerprint *fp, const IniEntry *entry) {
+  IniFingerprint h = entry_fingerprint(entry);
+  fp->hi += h.hi;
+  fp->lo += h.lo;
+}
+
+static void fingerprint_sub(IniFingerprint *fp, const IniEntry *entry) {
+  IniFingerprint h = entry_fingerprint(entry);
+  fp->hi -= h.hi;
+  fp->lo -= h.lo;
+}
+
+int ini_fingerprint_eq(IniFingerprint a, IniFingerprint b) {
+  return a.hi == b.hi && a.lo == b.lo;
+}
+
+// Room for one more entry, 0 when out of memory
+static int ini_index_reserve(IniEntryIndex *index,
+                             LinearAllocator *allocator) {
+  if (index->len == index->cap) {
+    // Grow by doubling, the old array is left behind in the allocator
+    size_t cap = index->cap ? index->cap * 2 : 8;
+    IniEntry *entries = allocator_alloc(allocator, cap * sizeof(IniEntry));
+    if (entries == NULL)
+      return 0;
+    if (index->len > 0)
+      memcpy(entries, index->entries, index->len * sizeof(IniEntry));
+    index->entries = entries;
+    index->cap = cap;
+  }
+  return 1;
+}
+
+int ini_index_push(IniEntryIndex *index, IniEntry entry,
+                   LinearAllocator *allocator) {
+  if (!ini_index_reserve(index, allocator))
+    return -1;
+
+  entry.order = index->len;
+  index->entries[index->len++] = entry;
+  fingerprint_add(&index->fingerprint, &entry);
+  return 0;
+}
+
+// input needs no NUL terminator, only input_len bytes are ever read
+IniParser new_parser(const char *input, size_t input_len) {
+  IniParser parser = {
+      .input = input,
+      .input_len = input_len,
+      .read_position = 1,
+      .ch = input_len > 0 ? input[0] : INI_EOF,
+      .error = INI_OK,
+      .limits = {SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX},
+  };
+  if (input_len > 0 && parser.ch == '\0')
+    parser.error = INI_ERR_SYNTAX;
   return parser;
 }
 
+static size_t limit_or_max(size_t limit) {
+  return limit > 0 ? limit : SIZE_MAX;
+}
+
+// Zero fields of limits stay unlimited
+void parser_set_limits(IniParser *parser, const IniLimits *limits) {
+  parser->limits.max_line_len = limit_or_max(limits->max_line_len);
+  parser->limits.max_key_len = limit_or_max(limits->max_key_len);
+  parser->limits.max_sections = limit_or_max(limits->max_sections);
+  parser->limits.max_entries = limit_or_max(limits->max_entries);
+  parser->limits.max_probes = limit_or_max(limits->max_probes);
+}
+
+// Limits and allow_truncated from options, NULL keeps the defaults
+static void parser_set_options(IniParser *parser, const IniOptions *options) {
+  if (options == NULL)
+    return;
+  parser_set_limits(parser, &options->limits);
+  parser->allow_truncated = options->allow_truncated;
+}
+
+static size_t options_budget(const IniOptions *options) {
+  return options != NULL ? options->memory_budget : 0;
+}
+
 int is_digit(char ch) { return '0' <= ch && ch <= '9'; }
 int is_valid_char(char ch) {
   return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ch == '_' ||
@@ -251,12 +1074,23 @@ int is_valid_char(char ch) {
 }
 
 void read_char(IniParser *parser) {
+  COUNT(read_chars, 1);
   // Check if at end of input
   if (parser->read_position >= parser->input_len) {
-    parser->ch = '0'; // EOF
+    parser->ch = INI_EOF;
   } else {
     // Read the current char
     parser->ch = parser->input[parser->read_position];
+    if (parser->ch == '\0') {
+      parser->error = INI_ERR_SYNTAX;
+    } else if (parser->ch == '\n') {
+      parser->line_start = parser->read_position + 1;
+    } else if (parser->read_position - parser->line_start >=
+               parser->limits.max_line_len) {
+      // Posing as the end of input stops every loop in the parser
+      parser->error = INI_ERR_LINE_TOO_LONG;
+      parser->ch = INI_EOF;
+    }
   }
   // Move position to last read position
   parser->position = parser->read_position;
@@ -264,27 +1098,36 @@ void read_char(IniParser *parser) {
   parser->read_position += 1;
 }
 
-char *read_literal(IniParser *parser, LinearAllocator *allocator) {
-  int pos = parser->position;
+// NULL when out of memory, with parser->error set, or when the literal is
+// longer than max_len. Scanning stops right after max_len chars, so an
+// oversized literal is never copied.
+char *read_literal(IniParser *parser, LinearAllocator *allocator,
+                   size_t max_len) {
+  size_t pos = parser->position;
 
   // TODO: No int type for now
   while (is_valid_char(parser->ch)) {
+    if (parser->position - pos == max_len)
+      return NULL;
     read_char(parser);
   }
 
-  int substr_len = parser->position - pos;
+  size_t substr_len = parser->position - pos;
   char *literal = allocator_alloc(allocator, substr_len + 1);
+  if (literal == NULL) {
+    parser->error = INI_ERR_MEMORY;
+    return NULL;
+  }
 
-  strncpy(literal, parser->input + pos, substr_len);
+  memcpy(literal, parser->input + pos, substr_len);
   literal[substr_len] = '\0';
 
   return literal;
 }
 
 void skip_to_next_line(IniParser *parser) {
-  while (parser->ch != '\n') {
-    if (parser->ch == '0')
-      exit(EXIT_FAILURE);
+  while (parser->ch != '\n' && parser->ch != INI_EOF) {
+    COUNT(comment_skipped, 1);
     read_char(parser);
   }
 }
@@ -292,33 +1135,140 @@ void skip_to_next_line(IniParser *parser) {
 void skip_whitespace(IniParser *parser) {
   while (parser->ch == ' ' || parser->ch == '\t' || parser->ch == '\r' ||
          parser->ch == '\n') {
+    COUNT(whitespace_skipped, 1);
+    read_char(parser);
+  }
+}
+
+// Whitespace within a line, so a key and its value never span two lines
+// and a stream can cut the input at any newline
+static void skip_blanks(IniParser *parser) {
+  while (parser->ch == ' ' || parser->ch == '\t' || parser->ch == '\r') {
+    COUNT(whitespace_skipped, 1);
     read_char(parser);
   }
 }
 
+// Table keys are "section.key", or just "key" before the first section
+char *qualify_key(const char *section, const char *key,
+                  LinearAllocator *allocator) {
+  if (section == NULL || section[0] == '\0')
+    return (char *)key;
+
+  size_t section_len = strlen(section);
+  size_t key_len = strlen(key);
+  char *qualified = allocator_alloc(allocator, section_len + key_len + 2);
+  if (qualified == NULL)
+    return NULL;
+
+  memcpy(qualified, section, section_len);
+  qualified[section_len] = '.';
+  memcpy(qualified + section_len + 1, key, key_len + 1);
+  return qualified;
+}
+
+// Input ended mid-line, fine only when the caller asked for it. An EOF
+// faked by an earlier error (a line over the limit) keeps that error.
+static int accept_truncated(IniParser *parser) {
+  if (parser->error != INI_OK)
+    return 0;
+  if (!parser->allow_truncated)
+    parser->error = INI_ERR_SYNTAX;
+  return parser->allow_truncated;
+}
+
 void parse_section_name(IniParser *parser, LinearAllocator *allocator) {
   // Lexer is at LBRACK move to next char, and read literal
   read_char(parser);
-  assert(is_valid_char(parser->ch));
+  if (parser->ch == INI_EOF) {
+    accept_truncated(parser);
+    return;
+  }
+  if (!is_valid_char(parser->ch)) {
+    parser->error = INI_ERR_SYNTAX;
+    return;
+  }
 
-  parser->section_name = read_literal(parser, allocator);
+  parser->section_name = read_literal(parser, allocator, SIZE_MAX);
+  if (parser->section_name == NULL)
+    return;
+  PROBE2(section_enter, parser->section_name, parser->position);
+#ifdef INI_TRACE
+  // A section's span runs from its header to the next one
+  if (parser->section_started != 0)
+    TRACE_END("section", parser->section_started);
+  parser->section_started = monotonic_ns();
+#endif
+  if (++parser->sections > parser->limits.max_sections) {
+    parser->error = INI_ERR_TOO_MANY_SECTIONS;
+    return;
+  }
 
-  assert(parser->ch == ']');
+  // A header cut off by the end of a slice still opens its section
+  if (parser->ch == INI_EOF) {
+    accept_truncated(parser);
+    return;
+  }
+  if (parser->ch != ']') {
+    parser->error = INI_ERR_SYNTAX;
+    return;
+  }
   // Move past closing bracket
   read_char(parser);
 }
 
 void parse_key_value(IniParser *parser, SHashTable *table,
                      LinearAllocator *allocator) {
-  const char *key = read_literal(parser, allocator);
-  skip_whitespace(parser);
+  const char *key = read_literal(parser, allocator, parser->limits.max_key_len);
+  if (key == NULL) {
+    if (parser->error == INI_OK)
+      parser->error = INI_ERR_KEY_TOO_LONG;
+    return;
+  }
+  skip_blanks(parser);
+  // A key cut off before its '=' is dropped, a cut off value is kept as is
+  if (parser->ch == INI_EOF) {
+    accept_truncated(parser);
+    return;
+  }
   // Move past assignment oper
-  assert(parser->ch == '=');
+  if (parser->ch != '=') {
+    parser->error = INI_ERR_SYNTAX;
+    return;
+  }
   read_char(parser);
-  skip_whitespace(parser);
+  skip_blanks(parser);
+
+  // Empty when nothing follows the '=' on its line
+  const char *val = read_literal(parser, allocator, SIZE_MAX);
+  if (val == NULL)
+    return;
+  if (++parser->entries > parser->limits.max_entries) {
+    parser->error = INI_ERR_TOO_MANY_ENTRIES;
+    return;
+  }
+  // Without a table the entry index is the only output
+  if (table != NULL) {
+    const char *qualified = qualify_key(parser->section_name, key, allocator);
+    if (qualified == NULL || shasht_set(table, qualified, (void *)val,
+                                        allocator, &parser->probes) == NULL) {
+      parser->error = INI_ERR_MEMORY;
+      return;
+    }
+    if (parser->probes > parser->limits.max_probes) {
+      parser->error = INI_ERR_PROBE_LIMIT;
+      return;
+    }
+  }
 
-  const char *val = read_literal(parser, allocator);
-  shasht_set(table, key, (void *)val, allocator);
+  if (parser->index != NULL &&
+      ini_index_push(parser->index,
+                     new_ini_entry(key, val, parser->section_name),
+                     allocator) != 0) {
+    parser->error = INI_ERR_MEMORY;
+    return;
+  }
+  PROBE3(entry_insert, parser->section_name, key, val);
 }
 
 int parse_next(IniParser *parser, SHashTable *table, LinearAllocator *allocator) {
@@ -332,44 +1282,85 @@ int parse_next(IniParser *parser, SHashTable *table, LinearAllocator *allocator)
     // Consume semi colon and skip to next non-whitespace/new line
     skip_to_next_line(parser);
     break;
-  case '0':
+  case INI_EOF:
+#ifdef INI_TRACE
+    if (parser->section_started != 0)
+      TRACE_END("section", parser->section_started);
+    parser->section_started = 0;
+#endif
     return 0; // No next values to parse
     break;
   default:
     if (is_valid_char(parser->ch)) {
       parse_key_value(parser, table, allocator);
     } else {
-      printf("Illegal token");
-      exit(EXIT_FAILURE);
+      parser->error = INI_ERR_SYNTAX;
     }
   }
 
+  // Stops at the first error, parser->position points at it
+  if (parser->error != INI_OK)
+    return 0;
   read_char(parser);
   return 1;
 }
 
-SHashTable *parse_ini(IniParser *parser, LinearAllocator *allocator) {
-  SHashTable *ini_table = shasht_init(allocator);
-  while (parse_next(parser, ini_table, allocator)) { }
-  return ini_table;
+// Parses up to the end of the input or the first error
+static void parse_rest(IniParser *parser, SHashTable *table,
+                       LinearAllocator *allocator) {
+  PROBE2(parse_start, parser->input, parser->input_len);
+  TRACE_START(start);
+  while (parse_next(parser, table, allocator)) { }
+  TRACE_END("parse", start);
+  PROBE2(parse_done, parser->entries, parser->error);
 }
 
-char *read_file(const char *path, LinearAllocator *allocator) {
-  FILE *file = fopen(path, "rb");
-  if (file == NULL) {
-    perror("File is null\n");
-    exit(1);
+// NULL with parser->error set on failure
+SHashTable *parse_ini(IniParser *parser, LinearAllocator *allocator) {
+  SHashTable *ini_table = shasht_init(allocator);
+  if (ini_table == NULL) {
+    parser->error = INI_ERR_MEMORY;
+    return NULL;
   }
+  parse_rest(parser, ini_table, allocator);
+  return parser->error == INI_OK ? ini_table : NULL;
+}
 
-  if (fseek(file, 0, SEEK_END) != 0) {
-    perror("Error seeking to end of file");
-    fclose(file);
-    return NULL;
+const char *ini_error_str(IniError error) {
+  switch (error) {
+  case INI_OK:
+    return "ok";
+  case INI_ERR_MEMORY:
+    return "out of memory";
+  case INI_ERR_SYNTAX:
+    return "syntax error";
+  case INI_ERR_LINE_TOO_LONG:
+    return "line too long";
+  case INI_ERR_KEY_TOO_LONG:
+    return "key too long";
+  case INI_ERR_TOO_MANY_SECTIONS:
+    return "too many sections";
+  case INI_ERR_TOO_MANY_ENTRIES:
+    return "too many entries";
+  case INI_ERR_PROBE_LIMIT:
+    return "hash table probe limit reached";
   }
+  return "unknown error";
+}
 
-  long filesize = ftell(file);
+// NUL terminated contents of path, "" for an empty file, and the length in
+// *len when len isn't NULL, which counts any '\0' bytes in the file. NULL
+// with errno set when the file can't be read or memory runs out.
+char *read_file(const char *path, LinearAllocator *allocator, size_t *len) {
+  TRACE_START(start);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+
+  long filesize = -1;
+  if (fseek(file, 0, SEEK_END) == 0)
+    filesize = ftell(file);
   if (filesize == -1) {
-    perror("Error getting filesize");
     fclose(file);
     return NULL;
   }
@@ -378,41 +1369,2075 @@ char *read_file(const char *path, LinearAllocator *allocator) {
 
   char *buf = allocator_alloc(allocator, filesize + 1);
   if (!buf) {
-    perror("No size left in allocator");
     fclose(file);
+    errno = ENOMEM;
     return NULL;
   }
 
+  // A file truncated since the seek reads short, that is an error too
   size_t bytes_read = fread(buf, 1, filesize, file);
-  if (bytes_read <= 0) {
-    printf("Error: did not read bytes");
-    exit(1);
+  if (bytes_read != (size_t)filesize) {
+    if (!ferror(file))
+      errno = EIO;
+    fclose(file);
+    return NULL;
   }
 
   buf[filesize] = '\0';
   fclose(file);
+  if (len != NULL)
+    *len = filesize;
 
+  TRACE_END("read", start);
   return buf;
 }
 
+/*
+ * ------------------------------------
+ * Config
+ * ------------------------------------
+ * A parsed file owning its allocator, table and sorted entry index
+ * ------------------------------------
+ */
+
+static const char *section_or_empty(const char *section) {
+  return section != NULL ? section : "";
+}
+
+// Orders entries by section then key, ties keep their input order
+static int ini_entry_cmp(const void *a, const void *b) {
+  const IniEntry *ea = a;
+  const IniEntry *eb = b;
+
+  int cmp = strcmp(section_or_empty(ea->section), section_or_empty(eb->section));
+  if (cmp == 0)
+    cmp = strcmp(ea->key, eb->key);
+  if (cmp == 0)
+    cmp = (ea->order > eb->order) - (ea->order < eb->order);
+  return cmp;
+}
+
+#define SORT_RUN 8
+
+// Stable, so equal keys keep their input order without the tie-break
+static void entry_insertion_sort(IniEntry *entries, size_t len) {
+  for (size_t i = 1; i < len; i++) {
+    IniEntry entry = entries[i];
+    size_t j = i;
+    while (j > 0 && ini_entry_cmp(&entries[j - 1], &entry) > 0) {
+      entries[j] = entries[j - 1];
+      j--;
+    }
+    entries[j] = entry;
+  }
+}
+
+static void entry_merge(const IniEntry *from, IniEntry *to, size_t lo,
+                        size_t mid, size_t hi) {
+  size_t i = lo, j = mid, out = lo;
+  while (i < mid && j < hi)
+    to[out++] = ini_entry_cmp(&from[j], &from[i]) < 0 ? from[j++] : from[i++];
+  while (i < mid)
+    to[out++] = from[i++];
+  while (j < hi)
+    to[out++] = from[j++];
+}
+
+// Bottom-up merge sort with its scratch taken from the allocator rather
+// than qsort's malloc, so it is recycled and counts towards the limit
+static int entry_sort(IniEntry *entries, size_t len,
+                      LinearAllocator *allocator) {
+  for (size_t lo = 0; lo < len; lo += SORT_RUN)
+    entry_insertion_sort(&entries[lo],
+                         len - lo < SORT_RUN ? len - lo : SORT_RUN);
+  if (len <= SORT_RUN)
+    return 0;
+
+  size_t bytes = len * sizeof(IniEntry);
+  IniEntry *scratch = allocator_alloc(allocator, bytes);
+  if (scratch == NULL)
+    return -1;
+
+  IniEntry *from = entries, *to = scratch;
+  for (size_t width = SORT_RUN; width < len; width *= 2) {
+    for (size_t lo = 0; lo < len; lo += 2 * width) {
+      size_t mid = lo + width < len ? lo + width : len;
+      size_t hi = lo + 2 * width < len ? lo + 2 * width : len;
+      entry_merge(from, to, lo, mid, hi);
+    }
+    IniEntry *swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != entries)
+    memcpy(entries, from, bytes);
+
+  // Nothing was allocated after the scratch, so hand it straight back
+  if ((uint8_t *)scratch + bytes == allocator->buffer + allocator->offset)
+    allocator->offset = (uint8_t *)scratch - allocator->buffer;
+  return 0;
+}
+
+// Sort the index and drop duplicate keys, keeping the last assignment.
+// -1 when the allocator can't hold the scratch, the index is then unsorted.
+int ini_index_sort(IniEntryIndex *index, LinearAllocator *allocator) {
+  if (index->len == 0)
+    return 0;
+  TRACE_START(start);
+
+  if (entry_sort(index->entries, index->len, allocator) != 0)
+    return -1;
+
+  size_t out = 0;
+  for (size_t i = 0; i < index->len; i++) {
+    IniEntry *entry = &index->entries[i];
+    if (out > 0) {
+      IniEntry *prev = &index->entries[out - 1];
+      if (strcmp(section_or_empty(prev->section),
+                 section_or_empty(entry->section)) == 0 &&
+          strcmp(prev->key, entry->key) == 0) {
+        // Overwritten entries no longer count towards the content
+        fingerprint_sub(&index->fingerprint, prev);
+        *prev = *entry;
+        continue;
+      }
+    }
+    index->entries[out++] = *entry;
+  }
+  index->len = out;
+  TRACE_END("index sort", start);
+  return 0;
+}
+
+// 0 when the budget doesn't even fit the empty table, config is then empty
+static int config_init_limit(IniConfig *config, size_t limit) {
+  config->index = (IniEntryIndex){0};
+  config->table = NULL;
+  if (!allocator_init_limit(&config->allocator, limit))
+    return 0;
+  config->table = shasht_init(&config->allocator);
+  if (config->table == NULL) {
+    ini_config_free(config);
+    return 0;
+  }
+  return 1;
+}
+
+// An empty config, ready for ini_set or streaming
+void ini_config_init(IniConfig *config) { config_init_limit(config, 0); }
+
+// -1 when the file can't be read (errno set) or doesn't parse. parser, when
+// not NULL, is left as the parse ended, its error is INI_OK when the read
+// failed. The file contents count towards the options' memory budget.
+static int load_file(IniConfig *config, const char *path, IniParser *parser,
+                     const IniOptions *options) {
+  IniParser local;
+  if (parser == NULL)
+    parser = &local;
+  config->index = (IniEntryIndex){0};
+  config->table = NULL;
+  if (!allocator_init_limit(&config->allocator, options_budget(options))) {
+    *parser = new_parser("", 0);
+    parser->error = INI_ERR_MEMORY;
+    ini_config_free(config);
+    return -1;
+  }
+
+  size_t len;
+  const char *input = read_file(path, &config->allocator, &len);
+  if (input == NULL) {
+    *parser = new_parser("", 0);
+    int saved = errno;
+    ini_config_free(config);
+    errno = saved;
+    return -1;
+  }
+
+  *parser = new_parser(input, len);
+  parser->index = &config->index;
+  parser_set_options(parser, options);
+
+  config->table = parse_ini(parser, &config->allocator);
+  if (config->table != NULL &&
+      ini_index_sort(&config->index, &config->allocator) != 0) {
+    parser->error = INI_ERR_MEMORY;
+    config->table = NULL;
+  }
+  if (config->table == NULL) {
+    ini_config_free(config);
+    return -1;
+  }
+  return 0;
+}
+
+// -1 when the file is missing, unreadable or malformed, an empty file is
+// an empty config. Prints nothing.
+int ini_load(IniConfig *config, const char *path) {
+  return load_file(config, path, NULL, NULL);
+}
+
+int ini_load_opts(IniConfig *config, const char *path,
+                  const IniOptions *options) {
+  return load_file(config, path, NULL, options);
+}
+
+int ini_parse_buffer(IniConfig *config, const char *input, size_t len) {
+  return ini_parse_buffer_opts(config, input, len, NULL) == INI_OK ? 0 : -1;
+}
+
+// On failure nothing is left allocated and config is empty
+IniError ini_parse_buffer_opts(IniConfig *config, const char *input,
+                               size_t len, const IniOptions *options) {
+  config->table = NULL;
+  config->index = (IniEntryIndex){0};
+  if (!allocator_init_limit(&config->allocator, options_budget(options))) {
+    ini_config_free(config);
+    return INI_ERR_MEMORY;
+  }
+
+  IniParser parser = new_parser(input, len);
+  parser.index = &config->index;
+  parser_set_options(&parser, options);
+
+  config->table = parse_ini(&parser, &config->allocator);
+  if (config->table != NULL &&
+      ini_index_sort(&config->index, &config->allocator) != 0) {
+    parser.error = INI_ERR_MEMORY;
+    config->table = NULL;
+  }
+  if (config->table == NULL) {
+    ini_config_free(config);
+    return parser.error;
+  }
+  return INI_OK;
+}
+
+void ini_config_free(IniConfig *config) {
+  allocator_free(&config->allocator);
+  config->table = NULL;
+  config->index = (IniEntryIndex){0};
+}
+
+// Binary search for (section, key), returns where it is or would be inserted
+static size_t ini_index_find(const IniEntryIndex *index, const char *section,
+                             const char *key, int *found) {
+  size_t lo = 0, hi = index->len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const IniEntry *entry = &index->entries[mid];
+    int cmp = strcmp(section_or_empty(entry->section), section_or_empty(section));
+    if (cmp == 0)
+      cmp = strcmp(entry->key, key);
+
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    }
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  *found = 0;
+  return lo;
+}
+
+static int qualified_key_eq(const char *qualified, const char *section,
+                            size_t section_len, const char *key,
+                            size_t key_len) {
+  if (section_len > 0) {
+    if (strncmp(qualified, section, section_len) != 0 ||
+        qualified[section_len] != '.')
+      return 0;
+    qualified += section_len + 1;
+  }
+  return strncmp(qualified, key, key_len) == 0 && qualified[key_len] == '\0';
+}
+
+// Hash of "section.key", or just "key" without a section
+static uint64_t qualified_hash(const char *section, size_t section_len,
+                               const char *key, size_t key_len) {
+  uint64_t hash = FNV_OFFSET;
+  if (section_len > 0) {
+    hash = hash_bytes(hash, section, section_len);
+    hash = hash_bytes(hash, ".", 1);
+  }
+  return hash_bytes(hash, key, key_len);
+}
+
+// Probe for "section.key" without building the qualified string
+static HTEntry *ini_find_slot(const IniConfig *config, uint64_t hash,
+                              const char *section, size_t section_len,
+                              const char *key, size_t key_len) {
+  SHashTable *table = config->table;
+
+  size_t index = hash & (table->cap - 1);
+  COUNT(get_probes, 1);
+  while (table->entries[index].key != NULL) {
+    COUNT(get_compares, 1);
+    if (qualified_key_eq(table->entries[index].key, section, section_len, key,
+                         key_len))
+      return &table->entries[index];
+
+    index = (index + 1) & (table->cap - 1);
+    COUNT(get_probes, 1);
+  }
+
+  return NULL;
+}
+
+const char *ini_lookup_hashed(const IniConfig *config, uint64_t hash,
+                              const char *section, size_t section_len,
+                              const char *key, size_t key_len) {
+  uint64_t start = latency_start();
+  HTEntry *slot =
+      ini_find_slot(config, hash, section, section_len, key, key_len);
+  latency_end(INI_LATENCY_LOOKUP, start);
+  if (slot == NULL) {
+    PROBE4(lookup_miss, section, section_len, key, key_len);
+    return NULL;
+  }
+  return slot->val;
+}
+
+const char *ini_lookup(const IniConfig *config, const char *section,
+                       size_t section_len, const char *key, size_t key_len) {
+  uint64_t hash = qualified_hash(section, section_len, key, key_len);
+  return ini_lookup_hashed(config, hash, section, section_len, key, key_len);
+}
+
+const char *ini_get(const IniConfig *config, const char *section,
+                    const char *key) {
+  section = section_or_empty(section);
+  return ini_lookup(config, section, strlen(section), key, strlen(key));
+}
+
+// Only names the parser could have produced, anything else (a '.' in
+// particular) could collide with another pair once qualified
+static int is_valid_name(const char *name, int allow_empty) {
+  if (name == NULL || name[0] == '\0')
+    return allow_empty;
+  for (; *name != '\0'; name++)
+    if (!is_valid_char(*name))
+      return 0;
+  return 1;
+}
+
+static int is_valid_pair(const char *section, const char *key) {
+  return is_valid_name(section, 1) && is_valid_name(key, 0);
+}
+
+// Set a value at runtime, keeping the table, index and fingerprint in sync.
+// Returns -1 when out of memory or for a section/key the parser couldn't
+// produce, with the config unchanged.
+int ini_set(IniConfig *config, const char *section, const char *key,
+            const char *value) {
+  if (!is_valid_pair(section, key))
+    return -1;
+
+  LinearAllocator *allocator = &config->allocator;
+  IniEntryIndex *index = &config->index;
+  const char *val = str_dup(value, allocator);
+  if (val == NULL)
+    return -1;
+
+  int found;
+  size_t pos = ini_index_find(index, section, key, &found);
+  if (found) {
+    IniEntry *entry = &index->entries[pos];
+    fingerprint_sub(&index->fingerprint, entry);
+    entry->val = val;
+    entry->hash = hash_key(val);
+    fingerprint_add(&index->fingerprint, entry);
+
+    section = section_or_empty(section);
+    size_t section_len = strlen(section), key_len = strlen(key);
+    uint64_t hash = qualified_hash(section, section_len, key, key_len);
+    ini_find_slot(config, hash, section, section_len, key, key_len)->val =
+        (void *)val;
+    return 0;
+  }
+
+  char *section_copy = NULL;
+  if (section != NULL && section[0] != '\0') {
+    section_copy = str_dup(section, allocator);
+    if (section_copy == NULL)
+      return -1;
+  }
+  const char *key_copy = str_dup(key, allocator);
+  const char *qualified =
+      key_copy ? qualify_key(section_copy, key_copy, allocator) : NULL;
+  // Reserve first so the table is never ahead of the index
+  if (qualified == NULL || !ini_index_reserve(index, allocator) ||
+      shasht_set(config->table, qualified, (void *)val, allocator, NULL) ==
+          NULL)
+    return -1;
+
+  IniEntry entry = new_ini_entry(key_copy, val, section_copy);
+  memmove(&index->entries[pos + 1], &index->entries[pos],
+          (index->len - pos) * sizeof(IniEntry));
+  entry.order = index->len;
+  index->entries[pos] = entry;
+  index->len += 1;
+  fingerprint_add(&index->fingerprint, &entry);
+  return 0;
+}
+
+// Returns 1 if the key was removed, 0 if absent, -1 for an invalid name
+int ini_delete(IniConfig *config, const char *section, const char *key) {
+  if (!is_valid_pair(section, key))
+    return -1;
+
+  IniEntryIndex *index = &config->index;
+
+  int found;
+  size_t pos = ini_index_find(index, section, key, &found);
+  if (!found)
+    return 0;
+
+  fingerprint_sub(&index->fingerprint, &index->entries[pos]);
+  memmove(&index->entries[pos], &index->entries[pos + 1],
+          (index->len - pos - 1) * sizeof(IniEntry));
+  index->len -= 1;
+
+  section = section_or_empty(section);
+  size_t section_len = strlen(section), key_len = strlen(key);
+  uint64_t hash = qualified_hash(section, section_len, key, key_len);
+  HTEntry *slot =
+      ini_find_slot(config, hash, section, section_len, key, key_len);
+  shasht_remove_at(config->table, slot - config->table->entries);
+  return 1;
+}
+
+/*
+ * ------------------------------------
+ * Streaming
+ * ------------------------------------
+ * Parses input as it arrives in chunks. Complete lines are parsed straight
+ * from the chunk, only a trailing partial line is carried over.
+ * ------------------------------------
+ */
+void ini_stream_init(IniStream *stream, IniConfig *config) {
+  ini_stream_init_opts(stream, config, NULL);
+}
+
+// -1 when the memory budget doesn't fit an empty config
+int ini_stream_init_opts(IniStream *stream, IniConfig *config,
+                         const IniOptions *options) {
+  stream->config = config;
+  stream->options = options != NULL ? *options : (IniOptions){0};
+  stream->section = NULL;
+  stream->carry = NULL;
+  stream->carry_len = 0;
+  stream->carry_cap = 0;
+  return config_init_limit(config, stream->options.memory_budget) ? 0 : -1;
+}
+
+static int stream_parse(IniStream *stream, const char *input, size_t len) {
+  IniConfig *config = stream->config;
+  IniParser parser = new_parser(input, len);
+  parser.section_name = stream->section;
+  parser.index = &config->index;
+  parser_set_options(&parser, &stream->options);
+
+  parse_rest(&parser, config->table, &config->allocator);
+  stream->section = parser.section_name;
+  return parser.error == INI_OK ? 0 : -1;
+}
+
+static int stream_carry(IniStream *stream, const char *data, size_t len) {
+  if (len == 0)
+    return 0;
+
+  if (stream->carry_len + len > stream->carry_cap) {
+    size_t cap = stream->carry_cap ? stream->carry_cap : 256;
+    while (cap < stream->carry_len + len)
+      cap *= 2;
+    char *grown = realloc(stream->carry, cap);
+    if (grown == NULL)
+      return -1;
+    stream->carry = grown;
+    stream->carry_cap = cap;
+  }
+
+  memcpy(stream->carry + stream->carry_len, data, len);
+  stream->carry_len += len;
+  return 0;
+}
+
+int ini_stream_feed(IniStream *stream, const char *chunk, size_t len) {
+  const char *last_newline = NULL;
+  for (size_t i = len; i > 0; i--) {
+    if (chunk[i - 1] == '\n') {
+      last_newline = chunk + i - 1;
+      break;
+    }
+  }
+
+  // No complete line yet
+  if (last_newline == NULL)
+    return stream_carry(stream, chunk, len);
+
+  size_t complete = last_newline - chunk + 1;
+  if (stream->carry_len == 0) {
+    if (stream_parse(stream, chunk, complete) != 0)
+      return -1;
+  } else {
+    if (stream_carry(stream, chunk, complete) != 0)
+      return -1;
+    int result = stream_parse(stream, stream->carry, stream->carry_len);
+    stream->carry_len = 0;
+    if (result != 0)
+      return -1;
+  }
+
+  return stream_carry(stream, chunk + complete, len - complete);
+}
+
+// Parses whatever is left and sorts the index, the config is then complete
+int ini_stream_finish(IniStream *stream) {
+  int result = 0;
+  // Parsed as is, a last line without its newline ends the input just as
+  // it would for ini_load
+  if (stream->carry_len > 0)
+    result = stream_parse(stream, stream->carry, stream->carry_len);
+
+  free(stream->carry);
+  stream->carry = NULL;
+  stream->carry_len = 0;
+  stream->carry_cap = 0;
+
+  IniConfig *config = stream->config;
+  if (ini_index_sort(&config->index, &config->allocator) != 0)
+    result = -1;
+  return result;
+}
+
+/*
+ * ------------------------------------
+ * Context
+ * ------------------------------------
+ * Parses many inputs one after another, recycling the allocator blocks,
+ * table storage and entry index of the previous parse
+ * ------------------------------------
+ */
+void ini_context_init(IniContext *context) {
+  ini_context_init_opts(context, NULL);
+}
+
+// The memory budget bounds the blocks the context keeps across parses.
+// -1 when it doesn't fit an empty config.
+int ini_context_init_opts(IniContext *context, const IniOptions *options) {
+  context->options = options != NULL ? *options : (IniOptions){0};
+  context->error = INI_OK;
+  context->index_cap = 0;
+  context->table_cap = 0;
+  if (!config_init_limit(&context->config, context->options.memory_budget))
+    return -1;
+  context->table_cap = context->config.table->cap;
+  return 0;
+}
+
+// The returned config is valid until the next parse on the same context,
+// NULL when the input is malformed or memory runs out
+const IniConfig *ini_context_parse(IniContext *context, const char *input,
+                                   size_t len) {
+  IniConfig *config = &context->config;
+  allocator_reset(&config->allocator);
+
+  // Sized to the largest previous parse, so steady state never grows.
+  // Allocated from recycled blocks, so this clears without a malloc.
+  context->error = INI_ERR_MEMORY;
+  config->table = shasht_init_cap(&config->allocator, context->table_cap);
+  config->index = (IniEntryIndex){0};
+  if (config->table == NULL)
+    return NULL;
+  if (context->index_cap > 0) {
+    config->index.entries =
+        allocator_alloc(&config->allocator, context->index_cap * sizeof(IniEntry));
+    if (config->index.entries == NULL)
+      return NULL;
+    config->index.cap = context->index_cap;
+  }
+
+  IniParser parser = new_parser(input, len);
+  parser.index = &config->index;
+  parser_set_options(&parser, &context->options);
+  parse_rest(&parser, config->table, &config->allocator);
+  if (parser.error == INI_OK &&
+      ini_index_sort(&config->index, &config->allocator) != 0)
+    parser.error = INI_ERR_MEMORY;
+  context->error = parser.error;
+  if (parser.error != INI_OK)
+    return NULL;
+
+  if (config->table->cap > context->table_cap)
+    context->table_cap = config->table->cap;
+  if (config->index.cap > context->index_cap)
+    context->index_cap = config->index.cap;
+  return config;
+}
+
+void ini_context_free(IniContext *context) {
+  ini_config_free(&context->config);
+  context->table_cap = 0;
+  context->index_cap = 0;
+}
+
+/*
+ * ------------------------------------
+ * Batch
+ * ------------------------------------
+ * Parses many small buffers in one call. Each result is only a sorted
+ * entry array, no hash table, all in the worker arenas of the batch.
+ * ------------------------------------
+ */
+#define BATCH_CHUNK 64
+
+int ini_batch_init(IniBatch *batch, size_t threads) {
+  return ini_batch_init_opts(batch, threads, NULL);
+}
+
+// The memory budget applies to each worker's arena, which holds the results
+// of every buffer it parsed. -1 when out of memory, nothing left allocated.
+int ini_batch_init_opts(IniBatch *batch, size_t threads,
+                        const IniOptions *options) {
+  size_t workers = threads > 0 ? threads : 1;
+  batch->options = options != NULL ? *options : (IniOptions){0};
+  batch->workers = 0;
+  batch->arenas = malloc(workers * sizeof(LinearAllocator));
+  if (batch->arenas == NULL)
+    return -1;
+
+  for (size_t i = 0; i < workers; i++) {
+    if (!allocator_init_limit(&batch->arenas[i],
+                              batch->options.memory_budget)) {
+      ini_batch_free(batch);
+      return -1;
+    }
+    batch->workers += 1;
+  }
+  return 0;
+}
+
+void ini_batch_free(IniBatch *batch) {
+  for (size_t i = 0; i < batch->workers; i++)
+    allocator_free(&batch->arenas[i]);
+  free(batch->arenas);
+  batch->arenas = NULL;
+  batch->workers = 0;
+}
+
+typedef struct {
+  LinearAllocator *arena;
+  const IniOptions *options;
+  const char *const *buffers;
+  const size_t *lens;
+  size_t n;
+  IniResult *results;
+  atomic_size_t *next; // Next unclaimed buffer, shared by the workers
+} BatchWorker;
+
+static void batch_parse_one(BatchWorker *worker, size_t i) {
+  IniEntryIndex index = {0};
+  IniParser parser = new_parser(worker->buffers[i], worker->lens[i]);
+  parser.index = &index;
+  parser_set_options(&parser, worker->options);
+  parse_rest(&parser, NULL, worker->arena);
+
+  if (parser.error == INI_OK && ini_index_sort(&index, worker->arena) != 0)
+    parser.error = INI_ERR_MEMORY;
+  // A failed buffer gets an empty result, the rest of the batch goes on
+  if (parser.error != INI_OK)
+    index = (IniEntryIndex){0};
+  worker->results[i].entries = index.entries;
+  worker->results[i].len = index.len;
+  worker->results[i].fingerprint = index.fingerprint;
+  worker->results[i].error = parser.error;
+}
+
+// Claims chunks of buffers until none are left, so uneven sizes balance out
+static void *batch_worker(void *arg) {
+  BatchWorker *worker = arg;
+  while (1) {
+    size_t start = atomic_fetch_add(worker->next, BATCH_CHUNK);
+    if (start >= worker->n)
+      break;
+
+    size_t end = start + BATCH_CHUNK < worker->n ? start + BATCH_CHUNK : worker->n;
+    TRACE_START(chunk);
+    for (size_t i = start; i < end; i++)
+      batch_parse_one(worker, i);
+    TRACE_END("batch chunk", chunk);
+  }
+  return NULL;
+}
+
+// Parse n buffers (not NUL terminated) into results. Results from the
+// previous call on the same batch are recycled.
+int ini_parse_batch(IniBatch *batch, const char *const buffers[],
+                    const size_t lens[], size_t n, IniResult results[]) {
+  atomic_size_t next = 0;
+  BatchWorker *workers = malloc(batch->workers * sizeof(BatchWorker));
+  pthread_t *threads = malloc(batch->workers * sizeof(pthread_t));
+  if (workers == NULL || threads == NULL) {
+    free(workers);
+    free(threads);
+    return -1;
+  }
+
+  for (size_t i = 0; i < batch->workers; i++) {
+    allocator_reset(&batch->arenas[i]);
+    workers[i] = (BatchWorker){&batch->arenas[i], &batch->options, buffers,
+                               lens, n, results, &next};
+  }
+
+  // Small batches aren't worth waking threads for
+  size_t spawn = n > BATCH_CHUNK ? batch->workers - 1 : 0;
+  size_t started = 0;
+  for (; started < spawn; started++) {
+    if (pthread_create(&threads[started], NULL, batch_worker,
+                       &workers[started + 1]) != 0)
+      break;
+  }
+  batch_worker(&workers[0]);
+  for (size_t i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  free(workers);
+  free(threads);
+  return 0;
+}
+
+const char *ini_result_get(const IniResult *result, const char *section,
+                           const char *key) {
+  IniEntryIndex view = {(IniEntry *)result->entries, result->len,
+                        result->len, {0, 0}};
+  int found;
+  size_t pos = ini_index_find(&view, section, key, &found);
+  return found ? result->entries[pos].val : NULL;
+}
+
+/*
+ * ------------------------------------
+ * Diff & Subscriptions
+ * ------------------------------------
+ * Linear merge over two sorted entry indexes, so that a reload
+ * only notifies the subscribers of keys that actually changed
+ * ------------------------------------
+ */
+
+static int entry_key_cmp(const char *section_a, const char *key_a,
+                         const char *section_b, const char *key_b) {
+  int cmp = strcmp(section_or_empty(section_a), section_or_empty(section_b));
+  if (cmp == 0)
+    cmp = strcmp(key_a, key_b);
+  return cmp;
+}
+
+// Calls fn for every added, removed or changed key, in (section, key) order.
+// Both indexes must be sorted, values are compared by hash only.
+size_t ini_diff(const IniEntryIndex *before, const IniEntryIndex *after,
+                IniChangeFn fn, void *user) {
+  size_t i = 0, j = 0, changes = 0;
+
+  while (i < before->len || j < after->len) {
+    const IniEntry *a = i < before->len ? &before->entries[i] : NULL;
+    const IniEntry *b = j < after->len ? &after->entries[j] : NULL;
+
+    int cmp;
+    if (a == NULL)
+      cmp = 1;
+    else if (b == NULL)
+      cmp = -1;
+    else
+      cmp = entry_key_cmp(a->section, a->key, b->section, b->key);
+
+    IniChange change = {0};
+    if (cmp < 0) {
+      change = (IniChange){INI_REMOVED, a, NULL};
+      i++;
+    } else if (cmp > 0) {
+      change = (IniChange){INI_ADDED, NULL, b};
+      j++;
+    } else {
+      i++;
+      j++;
+      if (a->hash == b->hash)
+        continue;
+      change = (IniChange){INI_CHANGED, a, b};
+    }
+
+    changes++;
+    if (fn != NULL)
+      fn(&change, user);
+  }
+
+  return changes;
+}
+
+void ini_subscribe(IniSubscriptions *subs, const char *section,
+                   const char *key, IniChangeFn callback, void *user) {
+  if (subs->len == subs->cap) {
+    size_t cap = subs->cap ? subs->cap * 2 : 8;
+    IniSubscriber *grown = realloc(subs->subs, cap * sizeof(IniSubscriber));
+    if (grown == NULL) {
+      fprintf(stderr, "Failed to allocate memory for subscription\n");
+      exit(EXIT_FAILURE);
+    }
+    subs->subs = grown;
+    subs->cap = cap;
+  }
+
+  subs->subs[subs->len++] = (IniSubscriber){section, key, callback, user};
+  subs->sorted = 0;
+}
+
+void ini_subscriptions_free(IniSubscriptions *subs) {
+  free(subs->subs);
+  *subs = (IniSubscriptions){0};
+}
+
+static int subscriber_cmp(const void *a, const void *b) {
+  const IniSubscriber *sa = a;
+  const IniSubscriber *sb = b;
+  return entry_key_cmp(sa->section, sa->key, sb->section, sb->key);
+}
+
+typedef struct {
+  IniSubscriptions *subs;
+  size_t cursor;
+} IniDispatch;
+
+// Changes arrive in sorted order, so the subscriber cursor only moves forward
+static void dispatch_change(const IniChange *change, void *user) {
+  IniDispatch *dispatch = user;
+  IniSubscriptions *subs = dispatch->subs;
+  const IniEntry *entry = change->after != NULL ? change->after : change->before;
+
+  while (dispatch->cursor < subs->len) {
+    IniSubscriber *sub = &subs->subs[dispatch->cursor];
+    if (entry_key_cmp(sub->section, sub->key, entry->section, entry->key) >= 0)
+      break;
+    dispatch->cursor++;
+  }
+
+  for (size_t i = dispatch->cursor; i < subs->len; i++) {
+    IniSubscriber *sub = &subs->subs[i];
+    if (entry_key_cmp(sub->section, sub->key, entry->section, entry->key) != 0)
+      break;
+    sub->callback(change, sub->user);
+  }
+}
+
+// Notify subscribers of every key that differs between the two indexes
+size_t ini_notify(IniSubscriptions *subs, const IniEntryIndex *before,
+                  const IniEntryIndex *after) {
+  if (!subs->sorted) {
+    if (subs->len > 0)
+      qsort(subs->subs, subs->len, sizeof(IniSubscriber), subscriber_cmp);
+    subs->sorted = 1;
+  }
+
+  IniDispatch dispatch = {subs, 0};
+  return ini_diff(before, after, dispatch_change, &dispatch);
+}
+
+// Parse path again and swap it in, then notify. Callbacks see the new
+// config, and the old entries in their changes stay valid until they return.
+// Returns -1 and keeps the current config when the file is missing,
+// malformed, empty or doesn't end in a newline, as it can be for a moment
+// while being written in place.
+int ini_reload(IniConfig *config, const char *path, IniSubscriptions *subs) {
+  return ini_reload_opts(config, path, subs, NULL);
+}
+
+int ini_reload_opts(IniConfig *config, const char *path,
+                    IniSubscriptions *subs, const IniOptions *options) {
+  TRACE_START(start);
+  uint64_t latency = latency_start();
+  IniConfig next;
+  IniParser parser;
+  if (load_file(&next, path, &parser, options) != 0)
+    return -1;
+  // Empty or without its last newline, the file may still be being written,
+  // possibly cut mid-value
+  if (parser.input_len == 0 || parser.input[parser.input_len - 1] != '\n') {
+    ini_config_free(&next);
+    return -1;
+  }
+
+  // Identical content, keep the current config and its pointers alive
+  if (ini_fingerprint_eq(config->index.fingerprint, next.index.fingerprint)) {
+    ini_config_free(&next);
+    TRACE_END("reload", start);
+    return 0;
+  }
+
+  // Publish first so callbacks see the new values, the old config is only
+  // freed once they're done with its entries
+  IniConfig old = *config;
+  *config = next;
+  size_t changes = 0;
+  if (subs != NULL) {
+    TRACE_START(notify);
+    changes = ini_notify(subs, &old.index, &config->index);
+    TRACE_END("notify", notify);
+  }
+  ini_config_free(&old);
+  PROBE3(reload_publish, path, config->index.len, changes);
+  latency_end(INI_LATENCY_RELOAD, latency);
+  TRACE_END("reload", start);
+  return 0;
+}
+
+/*
+ * ------------------------------------
+ * Journal
+ * ------------------------------------
+ * Append-only log of runtime ini_set/ini_delete calls, replayed on top
+ * of the parsed file at startup. fsync is batched every sync_every records.
+ * ------------------------------------
+ */
+#define JOURNAL_SET 1
+#define JOURNAL_DELETE 2
+
+// Each record is this header followed by the section, key and value bytes.
+// The checksum covers both, so a torn write at the tail fails to verify and
+// replay stops there. Records use host byte order.
+typedef struct {
+  uint32_t op;
+  uint32_t section_len;
+  uint32_t key_len;
+  uint32_t val_len;
+  uint64_t checksum;
+} JournalRecord;
+
+static uint64_t journal_checksum(const JournalRecord *record,
+                                 const char *section, const char *key,
+                                 const char *val) {
+  JournalRecord header = *record;
+  header.checksum = 0;
+
+  uint64_t hash = hash_bytes(FNV_OFFSET, (const char *)&header, sizeof(header));
+  hash = hash_bytes(hash, section, record->section_len);
+  hash = hash_bytes(hash, key, record->key_len);
+  return hash_bytes(hash, val, record->val_len);
+}
+
+// Bytes read, short only at end of file, -1 on a read error
+static ssize_t read_full(int fd, void *buf, size_t len) {
+  size_t total = 0;
+  while (total < len) {
+    ssize_t n = read(fd, (char *)buf + total, len - total);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    total += n;
+  }
+  return total;
+}
+
+// Open or create the journal at path and replay it onto config. A torn tail
+// is truncated away. Returns the number of records replayed, -1 on error,
+// in which case the journal file is left as it was.
+long ini_journal_open(IniJournal *journal, const char *path, IniConfig *config,
+                      size_t sync_every) {
+  journal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (journal->fd < 0) {
+    perror("Error opening journal");
+    return -1;
+  }
+  journal->pending = 0;
+  journal->sync_every = sync_every;
+  journal->failed = 0;
+
+  off_t size = lseek(journal->fd, 0, SEEK_END);
+  if (size < 0 || lseek(journal->fd, 0, SEEK_SET) != 0) {
+    perror("Error reading journal");
+    close(journal->fd);
+    return -1;
+  }
+
+  char *scratch = NULL;
+  size_t scratch_cap = 0;
+  off_t valid = 0;
+  long replayed = 0;
+  int failed = 0; // Stop without truncating, the rest may still be valid
+
+  JournalRecord record;
+  while (1) {
+    ssize_t got = read_full(journal->fd, &record, sizeof(record));
+    if (got < 0) {
+      failed = 1;
+      break;
+    }
+    if (got != sizeof(record) ||
+        (record.op != JOURNAL_SET && record.op != JOURNAL_DELETE))
+      break;
+
+    // Lengths running past the end of the file can only be a torn record
+    size_t payload =
+        (size_t)record.section_len + record.key_len + record.val_len;
+    if (payload > (size_t)(size - valid - sizeof(record)))
+      break;
+    if (payload + 3 > scratch_cap) {
+      char *grown = realloc(scratch, payload + 3);
+      if (grown == NULL) {
+        failed = 1;
+        break;
+      }
+      scratch = grown;
+      scratch_cap = payload + 3;
+    }
+
+    // Lay out as three NUL terminated strings
+    char *section = scratch;
+    char *key = section + record.section_len + 1;
+    char *val = key + record.key_len + 1;
+    if (read_full(journal->fd, section, record.section_len) !=
+            record.section_len ||
+        read_full(journal->fd, key, record.key_len) != record.key_len ||
+        read_full(journal->fd, val, record.val_len) != record.val_len) {
+      failed = 1; // Fits in the file, so this was a read error
+      break;
+    }
+    section[record.section_len] = '\0';
+    key[record.key_len] = '\0';
+    val[record.val_len] = '\0';
+
+    if (journal_checksum(&record, section, key, val) != record.checksum)
+      break;
+
+    if (record.op == JOURNAL_SET && ini_set(config, section, key, val) != 0) {
+      failed = 1;
+      break;
+    }
+    if (record.op == JOURNAL_DELETE && ini_delete(config, section, key) < 0) {
+      failed = 1;
+      break;
+    }
+
+    valid += sizeof(record) + payload;
+    replayed++;
+  }
+  free(scratch);
+
+  if (failed) {
+    fprintf(stderr, "Error replaying journal record %ld\n", replayed + 1);
+    close(journal->fd);
+    return -1;
+  }
+
+  if (ftruncate(journal->fd, valid) != 0) {
+    perror("Error truncating journal");
+    close(journal->fd);
+    return -1;
+  }
+
+  return replayed;
+}
+
+int ini_journal_sync(IniJournal *journal) {
+  if (journal->pending == 0)
+    return 0;
+
+  journal->pending = 0;
+  return fsync(journal->fd);
+}
+
+static int journal_append(IniJournal *journal, uint32_t op,
+                          const char *section, const char *key,
+                          const char *val) {
+  if (journal->failed || !is_valid_pair(section, key))
+    return -1;
+
+  section = section_or_empty(section);
+  JournalRecord record = {op, strlen(section), strlen(key), strlen(val), 0};
+  record.checksum = journal_checksum(&record, section, key, val);
+
+  // One writev per record so a crash leaves at most one torn record
+  struct iovec iov[4] = {
+      {&record, sizeof(record)},
+      {(void *)section, record.section_len},
+      {(void *)key, record.key_len},
+      {(void *)val, record.val_len},
+  };
+  size_t total =
+      sizeof(record) + record.section_len + record.key_len + record.val_len;
+  off_t start = lseek(journal->fd, 0, SEEK_END);
+  if (start < 0) {
+    perror("Error writing journal");
+    return -1;
+  }
+  ssize_t written = writev(journal->fd, iov, 4);
+  if (written != (ssize_t)total) {
+    if (written < 0)
+      perror("Error writing journal");
+    else
+      fprintf(stderr, "Short write to journal\n");
+    // Cut a short write back off, a torn record mid-file would stop replay
+    // before anything appended after it
+    if (written > 0 && ftruncate(journal->fd, start) != 0) {
+      perror("Error truncating journal");
+      journal->failed = 1;
+    }
+    return -1;
+  }
+
+  journal->pending += 1;
+  if (journal->sync_every > 0 && journal->pending >= journal->sync_every)
+    return ini_journal_sync(journal);
+  return 0;
+}
+
+// Log then apply, so anything applied is in the journal
+int ini_journal_set(IniJournal *journal, IniConfig *config,
+                    const char *section, const char *key, const char *value) {
+  if (journal_append(journal, JOURNAL_SET, section, key, value) != 0)
+    return -1;
+
+  return ini_set(config, section, key, value);
+}
+
+int ini_journal_delete(IniJournal *journal, IniConfig *config,
+                       const char *section, const char *key) {
+  if (journal_append(journal, JOURNAL_DELETE, section, key, "") != 0)
+    return -1;
+
+  ini_delete(config, section, key);
+  return 0;
+}
+
+int ini_journal_close(IniJournal *journal) {
+  int result = ini_journal_sync(journal);
+  close(journal->fd);
+  journal->fd = -1;
+  return result;
+}
+
+/*
+ * ------------------------------------
+ * Code Generation
+ * ------------------------------------
+ * Turns a schema file (section, key = int|float|bool|string) into a C
+ * header and source with a plain struct and a loader specialised to it
+ * ------------------------------------
+ */
+static const char *schema_c_type(const char *type) {
+  if (strcmp(type, "int") == 0)
+    return "int64_t";
+  if (strcmp(type, "float") == 0)
+    return "double";
+  if (strcmp(type, "bool") == 0)
+    return "int";
+  if (strcmp(type, "string") == 0)
+    return "const char *";
+  return NULL;
+}
+
+static const char *schema_c_convert(const char *type) {
+  if (strcmp(type, "int") == 0)
+    return "strtoll(val, NULL, 10)";
+  if (strcmp(type, "float") == 0)
+    return "strtod(val, NULL)";
+  if (strcmp(type, "bool") == 0)
+    return "parse_bool(val)";
+  return "val";
+}
+
+// Keywords up to C23, plus the macros of the headers the output includes
+static const char *const c_reserved[] = {
+    "alignas", "alignof", "auto", "bool", "break", "case", "char", "const",
+    "constexpr", "continue", "default", "do", "double", "else", "enum",
+    "extern", "false", "float", "for", "goto", "if", "inline", "int", "long",
+    "nullptr", "register", "restrict", "return", "short", "signed", "sizeof",
+    "static", "static_assert", "struct", "switch", "thread_local", "true",
+    "typedef", "typeof", "typeof_unqual", "union", "unsigned", "void",
+    "volatile", "while", "NULL", "offsetof",
+};
+
+// Usable as a name in generated C. Literals are already [A-Za-z0-9_]+.
+static int is_c_identifier(const char *name) {
+  if (name[0] == '\0' || is_digit(name[0]))
+    return 0;
+  // _Bool, __x and friends belong to the implementation
+  if (name[0] == '_' && (name[1] == '_' || ('A' <= name[1] && name[1] <= 'Z')))
+    return 0;
+  for (size_t i = 0; i < sizeof(c_reserved) / sizeof(c_reserved[0]); i++) {
+    if (strcmp(name, c_reserved[i]) == 0)
+      return 0;
+  }
+  return 1;
+}
+
+// Entries are sorted by section, so each section is one run of the index
+static size_t section_run_end(const IniEntryIndex *index, size_t start) {
+  const char *section = section_or_empty(index->entries[start].section);
+  size_t end = start;
+  while (end < index->len &&
+         strcmp(section_or_empty(index->entries[end].section), section) == 0)
+    end++;
+  return end;
+}
+
+static int schema_validate(const IniEntryIndex *schema) {
+  for (size_t i = 0; i < schema->len; i++) {
+    const IniEntry *entry = &schema->entries[i];
+    const char *section = section_or_empty(entry->section);
+    if (schema_c_type(entry->val) == NULL) {
+      fprintf(stderr, "Unknown type '%s' for %s.%s\n", entry->val, section,
+              entry->key);
+      return -1;
+    }
+    if (!is_c_identifier(entry->key) ||
+        (section[0] != '\0' && !is_c_identifier(section))) {
+      fprintf(stderr, "%s.%s is not a valid C identifier\n", section,
+              entry->key);
+      return -1;
+    }
+  }
+
+  // Top level keys and sections are members of the same struct
+  for (size_t start = 0; start < schema->len;
+       start = section_run_end(schema, start)) {
+    const char *section = section_or_empty(schema->entries[start].section);
+    int found;
+    if (section[0] != '\0') {
+      ini_index_find(schema, "", section, &found);
+      if (found) {
+        fprintf(stderr, "Key %s has the same name as section [%s]\n",
+                section, section);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void gen_header(FILE *out, const IniEntryIndex *schema,
+                       const char *name, const char *guard) {
+  fprintf(out, "// Generated by ini_parser --gen-c, do not edit\n");
+  fprintf(out, "#ifndef %s\n#define %s\n\n", guard, guard);
+  fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n\n");
+  fprintf(out, "typedef struct {\n");
+
+  for (size_t start = 0; start < schema->len;) {
+    size_t end = section_run_end(schema, start);
+    const char *section = section_or_empty(schema->entries[start].section);
+    const char *indent = section[0] != '\0' ? "    " : "  ";
+
+    if (section[0] != '\0')
+      fprintf(out, "  struct {\n");
+    for (size_t i = start; i < end; i++) {
+      const IniEntry *entry = &schema->entries[i];
+      const char *type = schema_c_type(entry->val);
+      fprintf(out, "%s%s%s%s;\n", indent, type,
+              type[strlen(type) - 1] == '*' ? "" : " ", entry->key);
+    }
+    if (section[0] != '\0')
+      fprintf(out, "  } %s;\n", section);
+
+    start = end;
+  }
+
+  fprintf(out, "} %s_t;\n\n", name);
+  fprintf(out,
+          "// Parse buf in place, NUL terminators are written into it so it\n"
+          "// needs room for len + 1 bytes, and string fields point into it.\n"
+          "// Unknown sections and keys are skipped. Returns 0, or the line\n"
+          "// number of the first malformed line.\n");
+  fprintf(out, "int %s_load(%s_t *cfg, char *buf, size_t len);\n\n", name,
+          name);
+  fprintf(out, "#endif\n");
+}
+
+// Emit "switch (len) { case n: if (hash == h && memcmp(...)) ... }" over
+// either section names or the keys of one section
+static void gen_key_switch(FILE *out, const IniEntryIndex *schema,
+                           size_t start, size_t end, int sections,
+                           int first_id, const char *indent) {
+  // Bucket by length, names are short so a scan per length is fine
+  size_t max_len = 0;
+  for (size_t i = start; i < end; i++) {
+    const IniEntry *entry = &schema->entries[i];
+    size_t len = strlen(sections ? section_or_empty(entry->section) : entry->key);
+    if (len > max_len)
+      max_len = len;
+  }
+
+  fprintf(out, "%sswitch (len) {\n", indent);
+  for (size_t len = 1; len <= max_len; len++) {
+    int opened = 0;
+    int section_id = first_id;
+    for (size_t i = start; i < end;) {
+      const IniEntry *entry = &schema->entries[i];
+      size_t next = sections ? section_run_end(schema, i) : i + 1;
+      const char *name = sections ? section_or_empty(entry->section) : entry->key;
+
+      if (strlen(name) == len) {
+        if (!opened) {
+          fprintf(out, "%scase %zu:\n", indent, len);
+          opened = 1;
+        }
+        fprintf(out,
+                "%s  if (hash == 0x%016llxULL && memcmp(name, \"%s\", %zu) == 0) {\n",
+                indent, (unsigned long long)hash_key(name), name, len);
+        if (sections) {
+          fprintf(out, "%s    return %d;\n", indent, section_id);
+        } else {
+          const char *section = section_or_empty(entry->section);
+          fprintf(out, "%s    cfg->%s%s%s = %s;\n%s    return;\n", indent,
+                  section, section[0] != '\0' ? "." : "", entry->key,
+                  schema_c_convert(entry->val), indent);
+        }
+        fprintf(out, "%s  }\n", indent);
+      }
+
+      section_id++;
+      i = next;
+    }
+    if (opened)
+      fprintf(out, "%s  break;\n", indent);
+  }
+  fprintf(out, "%s}\n", indent);
+}
+
+static void gen_source(FILE *out, const IniEntryIndex *schema,
+                       const char *name, const char *header) {
+  fprintf(out, "// Generated by ini_parser --gen-c, do not edit\n");
+  fprintf(out, "#include \"%s\"\n\n", header);
+  fprintf(out, "#include <stdlib.h>\n#include <string.h>\n\n");
+
+  fprintf(out, "static uint64_t hash_name(const char *name, size_t len) {\n"
+               "  uint64_t hash = 0x%016llxULL;\n"
+               "  for (size_t i = 0; i < len; i++) {\n"
+               "    hash ^= (unsigned char)name[i];\n"
+               "    hash *= 0x%016llxULL;\n"
+               "  }\n"
+               "  return hash;\n"
+               "}\n\n",
+          (unsigned long long)FNV_OFFSET, (unsigned long long)FNV_PRIME);
+
+  fprintf(out, "static int parse_bool(const char *val) {\n"
+               "  return strcmp(val, \"true\") == 0 || strcmp(val, \"1\") == 0 ||\n"
+               "         strcmp(val, \"yes\") == 0 || strcmp(val, \"on\") == 0;\n"
+               "}\n\n");
+
+  // Section ids follow the sorted index, the unnamed section sorts first
+  int has_top = schema->len > 0 && schema->entries[0].section == NULL;
+  fprintf(out, "static int find_section(const char *name, size_t len) {\n");
+  fprintf(out, "  uint64_t hash = hash_name(name, len);\n");
+  gen_key_switch(out, schema, has_top ? section_run_end(schema, 0) : 0,
+                 schema->len, 1, has_top, "  ");
+  fprintf(out, "  return -1;\n}\n\n");
+
+  fprintf(out,
+          "static void set_field(%s_t *cfg, int section, const char *name,\n"
+          "                      size_t len, char *val) {\n"
+          "  uint64_t hash = hash_name(name, len);\n"
+          "  switch (section) {\n",
+          name);
+  int section_id = 0;
+  for (size_t start = 0; start < schema->len; section_id++) {
+    size_t end = section_run_end(schema, start);
+    fprintf(out, "  case %d:\n", section_id);
+    gen_key_switch(out, schema, start, end, 0, 0, "    ");
+    fprintf(out, "    break;\n");
+    start = end;
+  }
+  fprintf(out, "  }\n}\n\n");
+
+  fprintf(out, "static int is_space(char ch) {\n"
+               "  return ch == ' ' || ch == '\\t' || ch == '\\r';\n"
+               "}\n\n");
+
+  fprintf(out,
+          "int %s_load(%s_t *cfg, char *buf, size_t len) {\n"
+          "  int section = %d;\n"
+          "  int line = 0;\n"
+          "  char *p = buf;\n"
+          "  char *end = buf + len;\n"
+          "\n"
+          "  while (p < end) {\n"
+          "    char *eol = memchr(p, '\\n', end - p);\n"
+          "    if (eol == NULL)\n"
+          "      eol = end;\n"
+          "    char *s = p;\n"
+          "    char *e = eol;\n"
+          "    p = eol + 1;\n"
+          "    line++;\n"
+          "\n"
+          "    while (s < e && is_space(*s))\n"
+          "      s++;\n"
+          "    while (e > s && is_space(e[-1]))\n"
+          "      e--;\n"
+          "    if (s == e || *s == ';')\n"
+          "      continue;\n"
+          "\n"
+          "    if (*s == '[') {\n"
+          "      if (e - s < 2 || e[-1] != ']')\n"
+          "        return line;\n"
+          "      section = find_section(s + 1, e - s - 2);\n"
+          "      continue;\n"
+          "    }\n"
+          "\n"
+          "    char *eq = memchr(s, '=', e - s);\n"
+          "    if (eq == NULL)\n"
+          "      return line;\n"
+          "    char *key_end = eq;\n"
+          "    while (key_end > s && is_space(key_end[-1]))\n"
+          "      key_end--;\n"
+          "    char *val = eq + 1;\n"
+          "    while (val < e && is_space(*val))\n"
+          "      val++;\n"
+          "    *e = '\\0';\n"
+          "\n"
+          "    if (section >= 0)\n"
+          "      set_field(cfg, section, s, key_end - s, val);\n"
+          "  }\n"
+          "\n"
+          "  return 0;\n"
+          "}\n",
+          name, name, has_top ? 0 : -1);
+}
+
+// Writes <prefix>.h and <prefix>.c, the struct is named after the basename
+int ini_gen_c(const IniEntryIndex *schema, const char *prefix) {
+  if (schema_validate(schema) != 0)
+    return -1;
+
+  const char *name = strrchr(prefix, '/');
+  name = name != NULL ? name + 1 : prefix;
+  if (!is_c_identifier(name)) {
+    fprintf(stderr, "%s is not a valid C identifier\n", name);
+    return -1;
+  }
+
+  size_t prefix_len = strlen(prefix);
+  size_t name_len = strlen(name);
+  char *header_path = malloc(prefix_len + 3);
+  char *source_path = malloc(prefix_len + 3);
+  char *guard = malloc(name_len + 3);
+  sprintf(header_path, "%s.h", prefix);
+  sprintf(source_path, "%s.c", prefix);
+  for (size_t i = 0; i < name_len; i++)
+    guard[i] = ('a' <= name[i] && name[i] <= 'z') ? name[i] - 'a' + 'A' : name[i];
+  strcpy(guard + name_len, "_H");
+
+  int result = -1;
+  FILE *header = fopen(header_path, "w");
+  FILE *source = fopen(source_path, "w");
+  if (header == NULL || source == NULL) {
+    perror("Error opening output file");
+  } else {
+    gen_header(header, schema, name, guard);
+    gen_source(source, schema, name, strrchr(header_path, '/') != NULL
+                                         ? strrchr(header_path, '/') + 1
+                                         : header_path);
+    result = 0;
+  }
+
+  if (header != NULL)
+    fclose(header);
+  if (source != NULL)
+    fclose(source);
+  free(header_path);
+  free(source_path);
+  free(guard);
+  return result;
+}
+
+/*
+ * ------------------------------------
+ * Embedding
+ * ------------------------------------
+ * Turns a parsed file into a C translation unit of const data: a string
+ * pool, the sorted entry table and a hash-and-displace perfect hash index
+ * ------------------------------------
+ */
+static uint64_t embed_hash(uint64_t seed, const char *section,
+                           const char *key) {
+  uint64_t hash = FNV_OFFSET ^ (seed * 0x9e3779b97f4a7c15ULL);
+  if (section[0] != '\0') {
+    hash = hash_bytes(hash, section, strlen(section));
+    hash = hash_bytes(hash, ".", 1);
+  }
+  return mix64(hash_bytes(hash, key, strlen(key)));
+}
+
+typedef struct {
+  size_t bucket;
+  size_t size;
+} EmbedBucket;
+
+static int embed_bucket_cmp(const void *a, const void *b) {
+  const EmbedBucket *ba = a;
+  const EmbedBucket *bb = b;
+  return (ba->size < bb->size) - (ba->size > bb->size);
+}
+
+// Hash and displace: each bucket of the first level hash gets the seed that
+// places all of its keys in free slots. Singletons skip the search and store
+// -(slot + 1) directly. Fills displace and slots (slot -> entry), n entries.
+static void embed_perfect_hash(const IniEntryIndex *index, int32_t *displace,
+                               uint32_t *slots) {
+  size_t n = index->len;
+  size_t *first = calloc(n + 1, sizeof(size_t));
+  size_t *members = malloc(n * sizeof(size_t));
+  size_t *placed = malloc(n * sizeof(size_t));
+  char *taken = calloc(n, 1);
+  EmbedBucket *buckets = malloc(n * sizeof(EmbedBucket));
+
+  // Counting sort entries into their first level bucket
+  for (size_t i = 0; i < n; i++) {
+    const IniEntry *entry = &index->entries[i];
+    first[embed_hash(0, section_or_empty(entry->section), entry->key) % n + 1]++;
+  }
+  for (size_t b = 0; b < n; b++) {
+    buckets[b] = (EmbedBucket){b, first[b + 1]};
+    first[b + 1] += first[b];
+  }
+  for (size_t i = 0; i < n; i++) {
+    const IniEntry *entry = &index->entries[i];
+    size_t b = embed_hash(0, section_or_empty(entry->section), entry->key) % n;
+    members[first[b] + --buckets[b].size] = i;
+  }
+  for (size_t b = 0; b < n; b++)
+    buckets[b].size = first[b + 1] - first[b];
+  qsort(buckets, n, sizeof(EmbedBucket), embed_bucket_cmp);
+
+  size_t free_slot = 0;
+  for (size_t i = 0; i < n && buckets[i].size > 0; i++) {
+    size_t b = buckets[i].bucket;
+    size_t size = buckets[i].size;
+    size_t *keys = &members[first[b]];
+
+    if (size == 1) {
+      while (taken[free_slot])
+        free_slot++;
+      taken[free_slot] = 1;
+      slots[free_slot] = keys[0];
+      displace[b] = -(int32_t)free_slot - 1;
+      continue;
+    }
+
+    for (uint64_t seed = 1;; seed++) {
+      size_t k = 0;
+      for (; k < size; k++) {
+        const IniEntry *entry = &index->entries[keys[k]];
+        size_t slot =
+            embed_hash(seed, section_or_empty(entry->section), entry->key) % n;
+        if (taken[slot])
+          break;
+        taken[slot] = 1;
+        placed[k] = slot;
+      }
+
+      if (k == size) {
+        for (k = 0; k < size; k++)
+          slots[placed[k]] = keys[k];
+        displace[b] = (int32_t)seed;
+        break;
+      }
+      // Undo the partial placement and try the next seed
+      while (k-- > 0)
+        taken[placed[k]] = 0;
+    }
+  }
+
+  free(first);
+  free(members);
+  free(placed);
+  free(taken);
+  free(buckets);
+}
+
+// Writes s as a C string literal, offsets into the pool stay byte exact
+static void embed_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (const char *p = s; *p; p++) {
+    unsigned char ch = *p;
+    if (is_valid_char(ch) || ch == '.' || ch == ' ')
+      fputc(ch, out);
+    else
+      fprintf(out, "\\%03o", ch);
+  }
+  fputs("\\0\"", out);
+}
+
+int ini_embed(FILE *out, const IniEntryIndex *index, const char *name) {
+  size_t n = index->len;
+  int32_t *displace = calloc(n > 0 ? n : 1, sizeof(int32_t));
+  uint32_t *slots = calloc(n > 0 ? n : 1, sizeof(uint32_t));
+  if (n > 0)
+    embed_perfect_hash(index, displace, slots);
+
+  fprintf(out, "// Generated by ini_parser --embed, do not edit\n");
+  fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n\n");
+
+  // Pool of "section\0key\0value\0" triples, entries hold offsets into it
+  fprintf(out, "static const char %s_pool[] =\n", name);
+  size_t offset = 0;
+  size_t *offsets = malloc((n > 0 ? n : 1) * sizeof(size_t));
+  for (size_t i = 0; i < n; i++) {
+    const IniEntry *entry = &index->entries[i];
+    const char *section = section_or_empty(entry->section);
+    offsets[i] = offset;
+    fprintf(out, "    ");
+    embed_string(out, section);
+    embed_string(out, entry->key);
+    embed_string(out, entry->val);
+    fprintf(out, "\n");
+    offset += strlen(section) + strlen(entry->key) + strlen(entry->val) + 3;
+  }
+  fprintf(out, "    \"\";\n\n");
+
+  fprintf(out, "// Sorted by (section, key), offsets of section, key and value\n");
+  fprintf(out, "static const uint32_t %s_entries[][3] = {\n", name);
+  for (size_t i = 0; i < n; i++) {
+    const IniEntry *entry = &index->entries[i];
+    size_t key = offsets[i] + strlen(section_or_empty(entry->section)) + 1;
+    fprintf(out, "    {%zu, %zu, %zu},\n", offsets[i], key,
+            key + strlen(entry->key) + 1);
+  }
+  if (n == 0)
+    fprintf(out, "    {0, 0, 0},\n");
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static const int32_t %s_displace[] = {", name);
+  for (size_t i = 0; i < (n > 0 ? n : 1); i++)
+    fprintf(out, "%s%d,", i % 12 == 0 ? "\n    " : " ", displace[i]);
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "static const uint32_t %s_slots[] = {", name);
+  for (size_t i = 0; i < (n > 0 ? n : 1); i++)
+    fprintf(out, "%s%u,", i % 12 == 0 ? "\n    " : " ", slots[i]);
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "const size_t %s_count = %zu;\n\n", name, n);
+
+  fprintf(out,
+          "static uint64_t %s_hash(uint64_t seed, const char *section,\n"
+          "    const char *key) {\n"
+          "  uint64_t hash = 0x%016llxULL ^ (seed * 0x9e3779b97f4a7c15ULL);\n"
+          "  const char *parts[3] = {section, \".\", key};\n"
+          "  for (int i = section[0] != '\\0' ? 0 : 2; i < 3; i++) {\n"
+          "    for (const char *p = parts[i]; *p; p++) {\n"
+          "      hash ^= (unsigned char)*p;\n"
+          "      hash *= 0x%016llxULL;\n"
+          "    }\n"
+          "  }\n"
+          "  hash ^= hash >> 33;\n"
+          "  hash *= 0xff51afd7ed558ccdULL;\n"
+          "  hash ^= hash >> 33;\n"
+          "  hash *= 0xc4ceb9fe1a85ec53ULL;\n"
+          "  hash ^= hash >> 33;\n"
+          "  return hash;\n"
+          "}\n\n",
+          name, (unsigned long long)FNV_OFFSET, (unsigned long long)FNV_PRIME);
+
+  fprintf(out,
+          "// Value of section.key, section is \"\" for keys before any section\n"
+          "const char *%s_get(const char *section, const char *key) {\n"
+          "  if (%s_count == 0)\n"
+          "    return NULL;\n"
+          "  int32_t d = %s_displace[%s_hash(0, section, key) %% %s_count];\n"
+          "  size_t slot = d < 0 ? (size_t)(-d - 1)\n"
+          "                      : %s_hash(d, section, key) %% %s_count;\n"
+          "  const uint32_t *entry = %s_entries[%s_slots[slot]];\n"
+          "  if (strcmp(%s_pool + entry[0], section) != 0 ||\n"
+          "      strcmp(%s_pool + entry[1], key) != 0)\n"
+          "    return NULL;\n"
+          "  return %s_pool + entry[2];\n"
+          "}\n\n",
+          name, name, name, name, name, name, name, name, name, name, name,
+          name);
+
+  fprintf(out,
+          "// Entry i in (section, key) order, for iterating the defaults\n"
+          "void %s_at(size_t i, const char **section, const char **key,\n"
+          "           const char **val) {\n"
+          "  *section = %s_pool + %s_entries[i][0];\n"
+          "  *key = %s_pool + %s_entries[i][1];\n"
+          "  *val = %s_pool + %s_entries[i][2];\n"
+          "}\n",
+          name, name, name, name, name, name, name);
+
+  free(offsets);
+  free(displace);
+  free(slots);
+  return 0;
+}
+
+// Command line, left out when main.c is linked into another program
+#ifndef INI_NO_MAIN
+// ini_load that says why it failed
+static int cli_load(IniConfig *config, const char *path) {
+  IniParser parser;
+  if (load_file(config, path, &parser, NULL) == 0)
+    return 0;
+  if (parser.error == INI_OK)
+    perror(path);
+  else
+    fprintf(stderr, "%s: %s at byte %zu\n", path, ini_error_str(parser.error),
+            parser.position);
+  return -1;
+}
+
+typedef struct {
+  const char *section; // Last section header printed
+} DiffPrinter;
+
+static void print_change(const IniChange *change, void *user) {
+  DiffPrinter *printer = user;
+  const IniEntry *entry = change->after != NULL ? change->after : change->before;
+  const char *section = section_or_empty(entry->section);
+
+  if (printer->section == NULL || strcmp(printer->section, section) != 0) {
+    printf("[%s]\n", section);
+    printer->section = section;
+  }
+
+  switch (change->kind) {
+  case INI_ADDED:
+    printf("+ %s = %s\n", entry->key, entry->val);
+    break;
+  case INI_REMOVED:
+    printf("- %s = %s\n", entry->key, entry->val);
+    break;
+  case INI_CHANGED:
+    printf("~ %s = %s -> %s\n", entry->key, change->before->val,
+           change->after->val);
+    break;
+  }
+}
+
+// Prints changes per section, exits 1 when the files differ like diff(1)
+static int diff_files(const char *path_a, const char *path_b) {
+  IniConfig a, b;
+  if (cli_load(&a, path_a) != 0)
+    return 2;
+  if (cli_load(&b, path_b) != 0) {
+    ini_config_free(&a);
+    return 2;
+  }
+
+  DiffPrinter printer = {NULL};
+  size_t changes = ini_diff(&a.index, &b.index, print_change, &printer);
+
+  ini_config_free(&a);
+  ini_config_free(&b);
+  return changes > 0 ? 1 : 0;
+}
+
+static int print_stats(const char *path) {
+  IniConfig config;
+  if (cli_load(&config, path) != 0)
+    return EXIT_FAILURE;
+
+  shasht_print_stats(config.table, stdout);
+
+  ini_config_free(&config);
+  return 0;
+}
+
+// Counts of one load, reading and parsing the file
+static int print_counters(const char *path) {
+#ifndef INI_COUNTERS
+  fprintf(stderr, "built without INI_COUNTERS, rebuild with -DINI_COUNTERS\n");
+  (void)path;
+  return EXIT_FAILURE;
+#else
+  IniConfig config;
+  ini_counters_reset();
+  if (cli_load(&config, path) != 0)
+    return EXIT_FAILURE;
+  IniCounters parse = ini_counters_get();
+  ini_counters_print(&parse, stdout);
+
+  ini_config_free(&config);
+  return 0;
+#endif
+}
+
+static int print_fingerprint(const char *path) {
+  IniConfig config;
+  if (cli_load(&config, path) != 0)
+    return EXIT_FAILURE;
+
+  IniFingerprint fp = config.index.fingerprint;
+  printf("%016llx%016llx\n", (unsigned long long)fp.hi,
+         (unsigned long long)fp.lo);
+
+  ini_config_free(&config);
+  return 0;
+}
+
+// Replay the journal onto the file, optionally applying one more mutation
+static int run_journal(int argc, char *argv[]) {
+  const char *journal_path = argv[2];
+  const char *file_path = argv[3];
+
+  IniConfig config;
+  if (cli_load(&config, file_path) != 0)
+    return EXIT_FAILURE;
+
+  IniJournal journal;
+  long replayed = ini_journal_open(&journal, journal_path, &config, 1);
+  if (replayed < 0) {
+    ini_config_free(&config);
+    return EXIT_FAILURE;
+  }
+  printf("Replayed %ld journal records\n", replayed);
+
+  int result = 0;
+  if (argc == 8 && strcmp(argv[4], "set") == 0) {
+    result = ini_journal_set(&journal, &config, argv[5], argv[6], argv[7]);
+  } else if (argc == 7 && strcmp(argv[4], "delete") == 0) {
+    result = ini_journal_delete(&journal, &config, argv[5], argv[6]);
+  } else if (argc != 4) {
+    fprintf(stderr, "Unknown journal operation\n");
+    result = -1;
+  }
+
+  if (result == 0)
+    shasht_print_debug(config.table);
+
+  ini_journal_close(&journal);
+  ini_config_free(&config);
+  return result == 0 ? 0 : EXIT_FAILURE;
+}
+
+static int gen_c(const char *schema_path, const char *prefix) {
+  IniConfig schema;
+  if (cli_load(&schema, schema_path) != 0)
+    return EXIT_FAILURE;
+
+  int result = ini_gen_c(&schema.index, prefix);
+  ini_config_free(&schema);
+  return result == 0 ? 0 : EXIT_FAILURE;
+}
+
+static int embed(const char *path, const char *name) {
+  if (!is_c_identifier(name)) {
+    fprintf(stderr, "%s is not a valid C identifier\n", name);
+    return EXIT_FAILURE;
+  }
+
+  IniConfig config;
+  if (cli_load(&config, path) != 0)
+    return EXIT_FAILURE;
+
+  int result = ini_embed(stdout, &config.index, name);
+  ini_config_free(&config);
+  return result == 0 ? 0 : EXIT_FAILURE;
+}
+
+// Parse every file with one context, as a batch validator would
+static int validate_files(int count, char *paths[]) {
+  IniContext context;
+  ini_context_init(&context);
+  LinearAllocator input_allocator;
+  allocator_init(&input_allocator);
+
+  int result = 0;
+  for (int i = 0; i < count; i++) {
+    allocator_reset(&input_allocator);
+    size_t len;
+    const char *input = read_file(paths[i], &input_allocator, &len);
+    if (input == NULL) {
+      perror(paths[i]);
+      result = EXIT_FAILURE;
+      continue;
+    }
+
+    const IniConfig *config = ini_context_parse(&context, input, len);
+    if (config == NULL) {
+      printf("%s: invalid\n", paths[i]);
+      result = EXIT_FAILURE;
+      continue;
+    }
+    printf("%s: %zu entries\n", paths[i], config->index.len);
+  }
+
+  allocator_free(&input_allocator);
+  ini_context_free(&context);
+  return result;
+}
+
+// Loads and reloads each file, then parses them all as one batch across
+// the cores, and writes the spans of every thread as Chrome trace JSON
+static int write_trace(const char *trace_path, int count, char *paths[]) {
+#ifndef INI_TRACE
+  fprintf(stderr, "built without INI_TRACE, rebuild with -DINI_TRACE\n");
+  (void)trace_path;
+  (void)count;
+  (void)paths;
+  return EXIT_FAILURE;
+#else
+  LinearAllocator input_allocator;
+  allocator_init(&input_allocator);
+  const char **inputs = malloc(count * sizeof(char *));
+  size_t *lens = malloc(count * sizeof(size_t));
+  IniResult *results = malloc(count * sizeof(IniResult));
+  if (inputs == NULL || lens == NULL || results == NULL) {
+    fprintf(stderr, "Failed to allocate memory for trace\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int result = 0;
+  for (int i = 0; i < count; i++) {
+    IniConfig config;
+    if (cli_load(&config, paths[i]) != 0 ||
+        ini_reload(&config, paths[i], NULL) != 0) {
+      result = EXIT_FAILURE;
+      inputs[i] = "";
+      lens[i] = 0;
+      continue;
+    }
+    ini_config_free(&config);
+
+    inputs[i] = read_file(paths[i], &input_allocator, &lens[i]);
+    if (inputs[i] == NULL) {
+      inputs[i] = "";
+      lens[i] = 0;
+    }
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  IniBatch batch;
+  if (ini_batch_init(&batch, cores > 0 ? cores : 1) != 0 ||
+      ini_parse_batch(&batch, inputs, lens, count, results) != 0) {
+    fprintf(stderr, "Failed to allocate memory for batch\n");
+    result = EXIT_FAILURE;
+  }
+  ini_batch_free(&batch);
+
+  FILE *out = fopen(trace_path, "w");
+  if (out == NULL || ini_trace_write(out) != 0) {
+    perror(trace_path);
+    result = EXIT_FAILURE;
+  }
+  if (out != NULL)
+    fclose(out);
+
+  free(inputs);
+  free(lens);
+  free(results);
+  allocator_free(&input_allocator);
+  return result;
+#endif
+}
+
+// Looks up every entry, and as many misses, rounds times, reloads the file
+// into an empty config as often, then prints the latency percentiles
+static int print_latency(const char *path, int rounds) {
+  IniConfig config;
+  if (cli_load(&config, path) != 0)
+    return EXIT_FAILURE;
+
+  ini_latency_reset();
+  ini_latency_enable(1);
+  for (int round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < config.index.len; i++) {
+      const IniEntry *entry = &config.index.entries[i];
+      ini_get(&config, entry->section, entry->key);
+      ini_get(&config, entry->key, entry->section != NULL ? entry->section : "");
+    }
+  }
+
+  int result = 0;
+  for (int round = 0; round < rounds; round++) {
+    IniConfig reloaded;
+    ini_config_init(&reloaded);
+    if (ini_reload(&reloaded, path, NULL) != 0)
+      result = EXIT_FAILURE;
+    ini_config_free(&reloaded);
+  }
+  ini_latency_enable(0);
+
+  ini_latency_print(stdout);
+  ini_config_free(&config);
+  return result;
+}
+
+static void usage(void) {
+  printf("Usage: ini_parser <path to ini file>\n");
+  printf("       ini_parser --diff <a.ini> <b.ini>\n");
+  printf("       ini_parser --stats <path to ini file>\n");
+  printf("       ini_parser --counters <path to ini file>\n");
+  printf("       ini_parser --latency <path to ini file> [rounds]\n");
+  printf("       ini_parser --fingerprint <path to ini file>\n");
+  printf("       ini_parser --journal <journal> <path to ini file> "
+         "[set <section> <key> <value> | delete <section> <key>]\n");
+  printf("       ini_parser --gen-c <schema.ini> <output prefix>\n");
+  printf("       ini_parser --embed <path to ini file> <name>\n");
+  printf("       ini_parser --validate <path to ini file>...\n");
+  printf("       ini_parser --trace <trace.json> <path to ini file>...\n");
+}
+
 int main(int argc, char *argv[]) {
+  if (argc == 4 && strcmp(argv[1], "--diff") == 0) {
+    return diff_files(argv[2], argv[3]);
+  }
+
+  if (argc == 3 && strcmp(argv[1], "--stats") == 0) {
+    return print_stats(argv[2]);
+  }
+
+  if (argc == 3 && strcmp(argv[1], "--counters") == 0) {
+    return print_counters(argv[2]);
+  }
+
+  if ((argc == 3 || argc == 4) && strcmp(argv[1], "--latency") == 0) {
+    int rounds = argc == 4 ? atoi(argv[3]) : 10;
+    return print_latency(argv[2], rounds > 0 ? rounds : 1);
+  }
+
+  if (argc == 3 && strcmp(argv[1], "--fingerprint") == 0) {
+    return print_fingerprint(argv[2]);
+  }
+
+  if (argc >= 4 && strcmp(argv[1], "--journal") == 0) {
+    return run_journal(argc, argv);
+  }
+
+  if (argc == 4 && strcmp(argv[1], "--gen-c") == 0) {
+    return gen_c(argv[2], argv[3]);
+  }
+
+  if (argc == 4 && strcmp(argv[1], "--embed") == 0) {
+    return embed(argv[2], argv[3]);
+  }
+
+  if (argc >= 3 && strcmp(argv[1], "--validate") == 0) {
+    return validate_files(argc - 2, argv + 2);
+  }
+
+  if (argc >= 4 && strcmp(argv[1], "--trace") == 0) {
+    return write_trace(argv[2], argc - 3, argv + 3);
+  }
+
   if (argc != 2) {
-    printf("Usage: ini_parser <path to ini file>\n");
+    usage();
     exit(EXIT_FAILURE);
   }
 
   const char *file_path = argv[1];
 
-  LinearAllocator allocator = {0, 0, 0};
-  allocator_init(&allocator);
-
-  const char *ini_input = read_file(file_path, &allocator);
-  IniParser parser = new_parser(ini_input, strlen(ini_input));
+  IniConfig config;
+  if (cli_load(&config, file_path) != 0)
+    exit(EXIT_FAILURE);
 
-  SHashTable *ini_data = parse_ini(&parser, &allocator);
-  shasht_print_debug(ini_data);
+  shasht_print_debug(config.table);
 
-  allocator_free(&allocator);
+  ini_config_free(&config);
 
   return 0;
 }
+#endif
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ini.h"
+
+/*
+ * ini_reload while the file is being replaced. Link against main.c built
+ * with -DINI_NO_MAIN:
+ *
+ *   cc -O2 -DINI_NO_MAIN -c main.c && cc -O2 -pthread test_reload.c main.o -lm -o test_reload
+ *   ./test_reload
+ */
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    if (!(cond)) {                                                           \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,       \
+              #cond);                                                        \
+      failures++;                                                            \
+    }                                                                        \
+  } while (0)
+
+static void write_text(const char *path, const char *text) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  fputs(text, file);
+  fclose(file);
+}
+
+typedef struct {
+  const IniConfig *config;
+  size_t calls;
+  IniChangeKind kind;
+  char seen[32]; // ini_get of the changed key from inside the callback
+} Recorder;
+
+static void record(const IniChange *change, void *user) {
+  Recorder *recorder = user;
+  recorder->calls++;
+  recorder->kind = change->kind;
+  const IniEntry *entry = change->after ? change->after : change->before;
+  const char *now = ini_get(recorder->config, entry->section, entry->key);
+  snprintf(recorder->seen, sizeof(recorder->seen), "%s", now ? now : "");
+}
+
+int main(void) {
+  char path[] = "/tmp/test_reload_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  write_text(path, "[http]\nport = 8080\nhost = local\n");
+  IniConfig config;
+  CHECK(ini_load(&config, path) == 0);
+
+  Recorder port = {&config, 0, INI_ADDED, ""};
+  Recorder host = {&config, 0, INI_ADDED, ""};
+  IniSubscriptions subs = {0};
+  ini_subscribe(&subs, "http", "port", record, &port);
+  ini_subscribe(&subs, "http", "host", record, &host);
+
+  // Renamed away mid-deploy
+  unlink(path);
+  CHECK(ini_reload(&config, path, &subs) == -1);
+  CHECK(ini_get(&config, "http", "port") != NULL);
+
+  // Truncated before the new contents are written
+  write_text(path, "");
+  CHECK(ini_reload(&config, path, &subs) == -1);
+  CHECK(ini_get(&config, "http", "port") != NULL);
+
+  // Half written
+  write_text(path, "[http]\nport = 9090\n[ht");
+  CHECK(ini_reload(&config, path, &subs) == -1);
+  write_text(path, "[http]\nport = 9090\nhost");
+  CHECK(ini_reload(&config, path, &subs) == -1);
+  // Cut mid-value, parses fine but isn't the whole file
+  write_text(path, "[http]\nport = 90");
+  CHECK(ini_reload(&config, path, &subs) == -1);
+  CHECK(strcmp(ini_get(&config, "http", "port"), "8080") == 0);
+  CHECK(port.calls == 0);
+
+  write_text(path, "[http]\nport = 9090\nhost = local\n");
+  CHECK(ini_reload(&config, path, &subs) == 0);
+  CHECK(strcmp(ini_get(&config, "http", "port"), "9090") == 0);
+  CHECK(port.calls == 1);
+  CHECK(port.kind == INI_CHANGED);
+  CHECK(strcmp(port.seen, "9090") == 0); // Published before notifying
+  CHECK(host.calls == 0);                // Unchanged keys aren't notified
+
+  ini_subscriptions_free(&subs);
+  ini_config_free(&config);
+  unlink(path);
+
+  if (failures > 0)
+    return EXIT_FAILURE;
+  printf("ok\n");
+  return 0;
+}